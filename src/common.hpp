@@ -12,6 +12,8 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <iostream>
 #include <math.h>
 #include <sstream>
@@ -19,6 +21,10 @@
 #include <sys/types.h>
 #include <fstream>
 #include <algorithm>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <random>
 
 using namespace std;
 #include <vector>
@@ -52,7 +52,18 @@ config _config = config {
 	-1.,
 	4, // Background model order
 	cpmNone,
-	false
+	false,
+	false, // Sparse features
+	"", "", // Feature matrix export and import
+	0, // RBF kernel approximation rank
+	0., // Largest accuracy loss for reduced support vector sets
+	false, // Single precision training feature vectors
+	10000., // LibSVM kernel cache size, in MB
+	100000, // Smallest training set for the dual coordinate descent solver
+	false, // Dual coordinate descent for quadratic kernels
+	0, // Largest subset for cascade SVM training, or 0 to train in one piece
+	true, // Warm start merged cascade SVM subsets
+	false, // Scale all multi-class SVM borders by the ranges over all classes
 };
 
 config*getConfiguration(){
@@ -94,8 +105,22 @@ void config::printInfo(){
 		default:{}
 	}
 	cout << "\n";
-	if(classifier == cSVMMOCCA || classifier == cSEQSVM)
+	if(sparseFeatures) cout << t_indent << "Sparse feature vectors: Enabled\n";
+	if(singleFeatures) cout << t_indent << "Single precision training feature vectors: Enabled\n";
+	if(classifier == cSVMMOCCA || classifier == cSEQSVM){
 		cout << t_indent << "SVM kernel: " << getKernelName(kernel) << "\n";
+		cout << t_indent << "SVM kernel cache: " << SVM_CacheSize << " MB\n";
+		if(SVM_DualCDMin > 0 && (kernel == kLinear || (kernel == kQuadratic && SVM_DualCDQuadratic)))
+			cout << t_indent << "SVM dual coordinate descent solver: from " << SVM_DualCDMin << " training examples\n";
+		if(SVM_CascadeSize > 0)
+			cout << t_indent << "SVM cascade training: subsets of " << SVM_CascadeSize << " training examples" << (SVM_CascadeWarmStart?"":", cold start") << "\n";
+		if(SVM_SharedScaling)
+			cout << t_indent << "SVM class borders: shared scaling over all classes\n";
+	}
+	if(SVM_RBFApproxRank && kernel == kRBF)
+		cout << t_indent << "RBF kernel approximation: " << SVM_RBFApproxRank << " random Fourier features\n";
+	if(SVM_ReduceMaxLoss > 0 && (kernel == kRBF || kernel == kCubic || kernel == kQuadratic))
+		cout << t_indent << "Reduced support vector sets: at most " << (SVM_ReduceMaxLoss*100.0) << " % disagreement\n";
 	if(genomeFASTAPath.length() > 0) cout << t_indent << "Genome: " << genomeFASTAPath << "\n";
 }
 
@@ -82,6 +82,17 @@ public:
 	int bgOrder;
 	corePredictionModeT corePredictionMode;
 	bool corePredictionMax;
+	bool sparseFeatures;
+	std::string featuresExportPath, featuresImportPath;
+	int SVM_RBFApproxRank;
+	double SVM_ReduceMaxLoss;
+	bool singleFeatures;
+	double SVM_CacheSize;
+	int SVM_DualCDMin;
+	bool SVM_DualCDQuadratic;
+	int SVM_CascadeSize;
+	bool SVM_CascadeWarmStart;
+	bool SVM_SharedScaling;
 	/*
 	printInfo
 		Prints out information
@@ -7,6 +7,10 @@
 #include <stdarg.h>
 #include <limits.h>
 #include <locale.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "svm.h"
 int libsvm_version = LIBSVM_VERSION;
 typedef float Qfloat;
@@ -184,6 +188,37 @@ void Cache::swap_index(int i, int j)
 	}
 }
 
+//
+// Worker threads for kernel columns
+//
+// The calling thread computes the first part of a range, and the workers
+// the rest. Ranges with less work than KERNEL_PARALLEL_MIN_WORK, in
+// multiply-adds, are computed by the calling thread alone.
+//
+#define KERNEL_PARALLEL_MIN_WORK 32768
+
+class Kernel;
+
+class KernelWorkers {
+public:
+	KernelWorkers(int n);
+	~KernelWorkers();
+	int size() const { return (int)threads.size()+1; }
+	void run(const Kernel *k, int i, int start, int len, Qfloat *data, const schar *y);
+private:
+	std::vector<std::thread> threads;
+	std::mutex m;
+	std::condition_variable wake, done;
+	const Kernel *job_kernel;
+	int job_i, job_start, job_len;
+	Qfloat *job_data;
+	const schar *job_y;
+	int generation, pending;
+	bool stop;
+	void work(int t);
+	void part(int t, int &begin, int &end) const;
+};
+
 //
 // Kernel evaluation
 //
@@ -211,15 +246,45 @@ public:
 	virtual void swap_index(int i, int j) const	// no so const...
 	{
 		swap(x[i],x[j]);
+		if(xd) swap(xd[i],xd[j]);
 		if(x_square) swap(x_square[i],x_square[j]);
 	}
+	// data[j] = y[i]*y[j]*K(i,j), or K(i,j) if y is null, for j in [start,end)
+	void compute_column(int i, int start, int end, Qfloat *data, const schar *y) const
+	{
+		if(y)
+		{
+			for(int j=start;j<end;j++)
+				data[j] = (Qfloat)(y[i]*y[j]*(this->*kernel_function)(i,j));
+		}
+		else
+		{
+			for(int j=start;j<end;j++)
+				data[j] = (Qfloat)(this->*kernel_function)(i,j);
+		}
+	}
 protected:
 
 	double (Kernel::*kernel_function)(int i, int j) const;
 
+	// compute_column, split between the worker threads if worthwhile
+	void fill_column(int i, int start, int end, Qfloat *data, const schar *y) const
+	{
+		if(workers && (end-start)*work_per_kernel >= KERNEL_PARALLEL_MIN_WORK)
+			workers->run(this,i,start,end,data,y);
+		else
+			compute_column(i,start,end,data,y);
+	}
+
 private:
 	const svm_node **x;
 	double *x_square;
+	// Dense copies of the vectors, if param.dense is set
+	const double **xd;
+	double *xd_data;
+	int dense_n;
+	double work_per_kernel;		// Average number of values per vector
+	KernelWorkers *workers;
 
 	// svm_parameter
 	const int kernel_type;
@@ -228,6 +293,29 @@ private:
 	const double coef0;
 
 	static double dot(const svm_node *px, const svm_node *py);
+	double dot_dense(const double *px, const double *py) const
+	{
+		double sum = 0;
+		for(int k=0;k<dense_n;k++)
+			sum += px[k] * py[k];
+		return sum;
+	}
+	double kernel_linear_dense(int i, int j) const
+	{
+		return dot_dense(xd[i],xd[j]);
+	}
+	double kernel_poly_dense(int i, int j) const
+	{
+		return powi(gamma*dot_dense(xd[i],xd[j])+coef0,degree);
+	}
+	double kernel_rbf_dense(int i, int j) const
+	{
+		return exp(-gamma*(x_square[i]+x_square[j]-2*dot_dense(xd[i],xd[j])));
+	}
+	double kernel_sigmoid_dense(int i, int j) const
+	{
+		return tanh(gamma*dot_dense(xd[i],xd[j])+coef0);
+	}
 	double kernel_linear(int i, int j) const
 	{
 		return dot(x[i],x[j]);
@@ -275,20 +363,138 @@ Kernel::Kernel(int l, svm_node * const * x_, const svm_parameter& param)
 
 	clone(x,x_,l);
 
+	xd = 0;
+	xd_data = 0;
+	dense_n = 0;
+	if(param.dense > 0 && kernel_type != PRECOMPUTED)
+	{
+		dense_n = param.dense;
+		xd_data = new double[(size_t)l*dense_n];
+		xd = new const double*[l];
+		for(int i=0;i<l;i++)
+		{
+			double *r = &xd_data[(size_t)i*dense_n];
+			for(int k=0;k<dense_n;k++)
+				r[k] = x[i][k].value;
+			xd[i] = r;
+		}
+		switch(kernel_type)
+		{
+			case LINEAR:
+				kernel_function = &Kernel::kernel_linear_dense;
+				break;
+			case POLY:
+				kernel_function = &Kernel::kernel_poly_dense;
+				break;
+			case RBF:
+				kernel_function = &Kernel::kernel_rbf_dense;
+				break;
+			case SIGMOID:
+				kernel_function = &Kernel::kernel_sigmoid_dense;
+				break;
+		}
+	}
+
 	if(kernel_type == RBF)
 	{
 		x_square = new double[l];
 		for(int i=0;i<l;i++)
-			x_square[i] = dot(x[i],x[i]);
+			x_square[i] = xd ? dot_dense(xd[i],xd[i]) : dot(x[i],x[i]);
 	}
 	else
 		x_square = 0;
+
+	if(dense_n)
+		work_per_kernel = dense_n;
+	else
+	{
+		double n = 0;
+		for(int i=0;i<l;i++)
+			for(const svm_node *p=x[i];p->index!=-1;p++)
+				n++;
+		work_per_kernel = l ? n/l : 0;
+	}
+	workers = 0;
+	if(param.nr_thread > 1)
+		workers = new KernelWorkers(param.nr_thread);
 }
 
 Kernel::~Kernel()
 {
+	delete workers;
 	delete[] x;
 	delete[] x_square;
+	delete[] xd;
+	delete[] xd_data;
+}
+
+KernelWorkers::KernelWorkers(int n)
+{
+	job_kernel = 0;
+	generation = 0;
+	pending = 0;
+	stop = false;
+	for(int t=1;t<n;t++)
+		threads.push_back(std::thread(&KernelWorkers::work,this,t));
+}
+
+KernelWorkers::~KernelWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(m);
+		stop = true;
+	}
+	wake.notify_all();
+	for(std::thread &t: threads)
+		t.join();
+}
+
+void KernelWorkers::part(int t, int &begin, int &end) const
+{
+	long n = job_len-job_start, nt = size();
+	begin = job_start+(int)(n*t/nt);
+	end = job_start+(int)(n*(t+1)/nt);
+}
+
+void KernelWorkers::run(const Kernel *k, int i, int start, int len, Qfloat *data, const schar *y)
+{
+	{
+		std::lock_guard<std::mutex> lock(m);
+		job_kernel = k;
+		job_i = i;
+		job_start = start;
+		job_len = len;
+		job_data = data;
+		job_y = y;
+		pending = (int)threads.size();
+		generation++;
+	}
+	wake.notify_all();
+	int begin, end;
+	part(0,begin,end);
+	k->compute_column(i,begin,end,data,y);
+	std::unique_lock<std::mutex> lock(m);
+	done.wait(lock,[this]{ return pending == 0; });
+}
+
+void KernelWorkers::work(int t)
+{
+	int seen = 0;
+	for(;;)
+	{
+		std::unique_lock<std::mutex> lock(m);
+		wake.wait(lock,[this,seen]{ return stop || generation != seen; });
+		if(stop)
+			return;
+		seen = generation;
+		int begin, end;
+		part(t,begin,end);
+		lock.unlock();
+		job_kernel->compute_column(job_i,begin,end,job_data,job_y);
+		lock.lock();
+		if(--pending == 0)
+			done.notify_one();
+	}
 }
 
 double Kernel::dot(const svm_node *px, const svm_node *py)
@@ -1279,12 +1485,9 @@ public:
 	Qfloat *get_Q(int i, int len) const
 	{
 		Qfloat *data;
-		int start, j;
+		int start;
 		if((start = cache->get_data(i,&data,len)) < len)
-		{
-			for(j=start;j<len;j++)
-				data[j] = (Qfloat)(y[i]*y[j]*(this->*kernel_function)(i,j));
-		}
+			fill_column(i,start,len,data,y);
 		return data;
 	}
 
@@ -1328,12 +1531,9 @@ public:
 	Qfloat *get_Q(int i, int len) const
 	{
 		Qfloat *data;
-		int start, j;
+		int start;
 		if((start = cache->get_data(i,&data,len)) < len)
-		{
-			for(j=start;j<len;j++)
-				data[j] = (Qfloat)(this->*kernel_function)(i,j);
-		}
+			fill_column(i,start,len,data,0);
 		return data;
 	}
 
@@ -1396,10 +1596,7 @@ public:
 		Qfloat *data;
 		int j, real_i = index[i];
 		if(cache->get_data(real_i,&data,l) < l)
-		{
-			for(j=0;j<l;j++)
-				data[j] = (Qfloat)(this->*kernel_function)(real_i,j);
-		}
+			fill_column(real_i,0,l,data,0);
 
 		// reorder and copy
 		Qfloat *buf = buffer[next_buffer];
@@ -1452,6 +1649,8 @@ static void solve_c_svc(
 		alpha[i] = 0;
 		minus_ones[i] = -1;
 		if(prob->y[i] > 0) y[i] = +1; else y[i] = -1;
+		if(prob->init_coef)
+			alpha[i] = min(fabs(prob->init_coef[i]),y[i] > 0 ? Cp : Cn);
 	}
 
 	Solver s;
@@ -1578,6 +1777,12 @@ static void solve_epsilon_svr(
 		alpha2[i+l] = 0;
 		linear_term[i+l] = param->p + prob->y[i];
 		y[i+l] = -1;
+
+		if(prob->init_coef)
+		{
+			alpha2[i] = min(max(prob->init_coef[i],0.0),param->C);
+			alpha2[i+l] = min(max(-prob->init_coef[i],0.0),param->C);
+		}
 	}
 
 	Solver s;
@@ -1916,6 +2121,7 @@ static void svm_binary_svc_probability(
 		subprob.l = prob->l-(end-begin);
 		subprob.x = Malloc(struct svm_node*,subprob.l);
 		subprob.y = Malloc(double,subprob.l);
+		subprob.init_coef = NULL;
 			
 		k=0;
 		for(j=0;j<begin;j++)
@@ -2199,16 +2405,23 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 				sub_prob.l = ci+cj;
 				sub_prob.x = Malloc(svm_node *,sub_prob.l);
 				sub_prob.y = Malloc(double,sub_prob.l);
+				sub_prob.init_coef = NULL;
+				if(prob->init_coef)
+					sub_prob.init_coef = Malloc(double,sub_prob.l);
 				int k;
 				for(k=0;k<ci;k++)
 				{
 					sub_prob.x[k] = x[si+k];
 					sub_prob.y[k] = +1;
+					if(prob->init_coef)
+						sub_prob.init_coef[k] = prob->init_coef[perm[si+k]];
 				}
 				for(k=0;k<cj;k++)
 				{
 					sub_prob.x[ci+k] = x[sj+k];
 					sub_prob.y[ci+k] = -1;
+					if(prob->init_coef)
+						sub_prob.init_coef[ci+k] = prob->init_coef[perm[sj+k]];
 				}
 
 				if(param->probability)
@@ -2223,6 +2436,7 @@ svm_model *svm_train(const svm_problem *prob, const svm_parameter *param)
 						nonzero[sj+k] = true;
 				free(sub_prob.x);
 				free(sub_prob.y);
+				free(sub_prob.init_coef);
 				++p;
 			}
 
@@ -2422,6 +2636,7 @@ void svm_cross_validation(const svm_problem *prob, const svm_parameter *param, i
 		subprob.l = l-(end-begin);
 		subprob.x = Malloc(struct svm_node*,subprob.l);
 		subprob.y = Malloc(double,subprob.l);
+		subprob.init_coef = NULL;
 			
 		k=0;
 		for(j=0;j<begin;j++)
@@ -20,6 +20,7 @@ struct svm_problem
 	int l;
 	double *y;
 	struct svm_node **x;
+	double *init_coef;	/* if not NULL, coefficients to start from (C_SVC and EPSILON_SVR) */
 };
 
 enum { C_SVC, NU_SVC, ONE_CLASS, EPSILON_SVR, NU_SVR };	/* svm_type */
@@ -44,6 +45,8 @@ struct svm_parameter
 	double p;	/* for EPSILON_SVR */
 	int shrinking;	/* use the shrinking heuristics */
 	int probability; /* do probability estimates */
+	int nr_thread;	/* threads computing kernel columns, 0 or 1 for none */
+	int dense;	/* if > 0, every vector has values for indices 0 to dense-1, in order */
 };
 
 //
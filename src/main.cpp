@@ -710,6 +710,80 @@ cmdArg argumentTypes[] = {
 			return true;
 		}
 	},
+	{
+		// Argument
+		"-features:sparse",
+		// Pass
+		1,
+		// Parameters
+		0,
+		// Documentation
+		"-features:sparse",
+		{ "Uses sparse feature vectors for SEQSVM and SEQLO, so that",
+		  "memory use and application time scale with the number of",
+		  "non-zero features. For SEQSVM, feature values are scaled by",
+		  "their maximal absolute values, rather than to [-1, 1]." },
+		// Code
+		[](std::vector<std::string> params, config*cfg, motifList*ml, featureSet*features, seqList*trainseq, seqList*calseq, seqList*valseq) -> bool {
+			cfg->sparseFeatures = true;
+			return true;
+		}
+	},
+	{
+		// Argument
+		"-features:float",
+		// Pass
+		1,
+		// Parameters
+		0,
+		// Documentation
+		"-features:float",
+		{ "Stores training feature vectors in single precision, halving",
+		  "their memory use. Applies to classifiers other than SVMs,",
+		  "which train on double precision LibSVM vectors." },
+		// Code
+		[](std::vector<std::string> params, config*cfg, motifList*ml, featureSet*features, seqList*trainseq, seqList*calseq, seqList*valseq) -> bool {
+			cfg->singleFeatures = true;
+			return true;
+		}
+	},
+	{
+		// Argument
+		"-features:export",
+		// Pass
+		1,
+		// Parameters
+		1,
+		// Documentation
+		"-features:export PATH",
+		{ "Saves the training feature vectors of SEQSVM, SEQRF or SEQLO",
+		  "to a binary feature matrix file, with feature names and",
+		  "class labels." },
+		// Code
+		[](std::vector<std::string> params, config*cfg, motifList*ml, featureSet*features, seqList*trainseq, seqList*calseq, seqList*valseq) -> bool {
+			cfg->featuresExportPath = params[0];
+			return true;
+		}
+	},
+	{
+		// Argument
+		"-features:import",
+		// Pass
+		1,
+		// Parameters
+		1,
+		// Documentation
+		"-features:import PATH",
+		{ "Trains SEQSVM, SEQRF or SEQLO on feature vectors from a",
+		  "feature matrix file saved with -features:export, instead of",
+		  "extracting features from training sequences. The motifs,",
+		  "features and window settings must be the same as for export." },
+		// Code
+		[](std::vector<std::string> params, config*cfg, motifList*ml, featureSet*features, seqList*trainseq, seqList*calseq, seqList*valseq) -> bool {
+			cfg->featuresImportPath = params[0];
+			return true;
+		}
+	},
 	//---------------------------
 	// SVM-MOCCA features
 	{
@@ -1223,6 +1297,177 @@ cmdArg argumentTypes[] = {
 			return true;
 		}
 	},
+	{
+		// Argument
+		"-SVM:RBF:approx",
+		// Pass
+		1,
+		// Parameters
+		1,
+		// Documentation
+		"-SVM:RBF:approx RANK",
+		{ "Applies RBF kernel SVM models approximately, as linear models",
+		  "over RANK random Fourier features. The approximation error",
+		  "on the training set is reported with the model information." },
+		// Code
+		[](std::vector<std::string> params, config*cfg, motifList*ml, featureSet*features, seqList*trainseq, seqList*calseq, seqList*valseq) -> bool {
+			cfg->SVM_RBFApproxRank = (int)strtol(params[0].c_str(), 0, 10);
+			if(cfg->SVM_RBFApproxRank <= 0){
+				argSyntaxError();
+				return false;
+			}
+			return true;
+		}
+	},
+	{
+		// Argument
+		"-SVM:reduce",
+		// Pass
+		1,
+		// Parameters
+		1,
+		// Documentation
+		"-SVM:reduce LOSS",
+		{ "Replaces the support vectors of RBF and polynomial kernel SVM",
+		  "models with smaller reduced sets, fitted to the full models. The",
+		  "smallest set is chosen that classifies at most a fraction LOSS",
+		  "of sampled training examples differently than the full model.",
+		  "The speed/accuracy trade-off is reported with the model information." },
+		// Code
+		[](std::vector<std::string> params, config*cfg, motifList*ml, featureSet*features, seqList*trainseq, seqList*calseq, seqList*valseq) -> bool {
+			cfg->SVM_ReduceMaxLoss = strtod(params[0].c_str(), 0);
+			if(cfg->SVM_ReduceMaxLoss <= 0 || cfg->SVM_ReduceMaxLoss >= 1){
+				argSyntaxError();
+				return false;
+			}
+			return true;
+		}
+	},
+	{
+		// Argument
+		"-SVM:pool",
+		// Pass
+		1,
+		// Parameters
+		0,
+		// Documentation
+		"-SVM:pool",
+		{ "Scales every class border of multi-class RBF and wide cubic SVMs",
+		  "by the feature ranges over all classes, instead of over its own two",
+		  "classes, so that their support vectors can always be pooled. With",
+		  "more than two classes, this trains different border models.",
+		  "Without it, support vectors are only pooled when the ranges of",
+		  "each border already match those over all classes." },
+		// Code
+		[](std::vector<std::string> params, config*cfg, motifList*ml, featureSet*features, seqList*trainseq, seqList*calseq, seqList*valseq) -> bool {
+			cfg->SVM_SharedScaling = true;
+			return true;
+		}
+	},
+	{
+		// Argument
+		"-SVM:cache",
+		// Pass
+		1,
+		// Parameters
+		1,
+		// Documentation
+		"-SVM:cache MB",
+		{ "Sets the size limit of the LibSVM kernel cache for each SVM",
+		  "being trained. Default: 10000 MB." },
+		// Code
+		[](std::vector<std::string> params, config*cfg, motifList*ml, featureSet*features, seqList*trainseq, seqList*calseq, seqList*valseq) -> bool {
+			cfg->SVM_CacheSize = strtod(params[0].c_str(), 0);
+			if(cfg->SVM_CacheSize <= 0){
+				argSyntaxError();
+				return false;
+			}
+			return true;
+		}
+	},
+	{
+		// Argument
+		"-SVM:DCD",
+		// Pass
+		1,
+		// Parameters
+		1,
+		// Documentation
+		"-SVM:DCD N",
+		{ "Trains linear kernel SVMs by dual coordinate descent instead of",
+		  "with LibSVM, when there are at least N training examples.",
+		  "The bias is regularized, so models differ slightly from LibSVM's.",
+		  "0 disables. Default: 100000." },
+		// Code
+		[](std::vector<std::string> params, config*cfg, motifList*ml, featureSet*features, seqList*trainseq, seqList*calseq, seqList*valseq) -> bool {
+			cfg->SVM_DualCDMin = (int)strtol(params[0].c_str(), 0, 10);
+			if(cfg->SVM_DualCDMin < 0){
+				argSyntaxError();
+				return false;
+			}
+			return true;
+		}
+	},
+	{
+		// Argument
+		"-SVM:DCD:quadratic",
+		// Pass
+		1,
+		// Parameters
+		0,
+		// Documentation
+		"-SVM:DCD:quadratic",
+		{ "Also trains quadratic kernel SVMs with at most 64 features by dual",
+		  "coordinate descent over the explicit feature map of the kernel.",
+		  "Training examples are centered, and the bias is regularized, so",
+		  "the model differs from the LibSVM quadratic SVM." },
+		// Code
+		[](std::vector<std::string> params, config*cfg, motifList*ml, featureSet*features, seqList*trainseq, seqList*calseq, seqList*valseq) -> bool {
+			cfg->SVM_DualCDQuadratic = true;
+			return true;
+		}
+	},
+	{
+		// Argument
+		"-SVM:cascade",
+		// Pass
+		1,
+		// Parameters
+		1,
+		// Documentation
+		"-SVM:cascade N",
+		{ "Trains C-SVC and epsilon-SVR models with more than N training",
+		  "examples as a cascade: disjoint subsets of at most N examples are",
+		  "trained in parallel, and their support vectors merged and",
+		  "retrained pairwise. The result is refined with the training",
+		  "examples violating its margin, until there are none." },
+		// Code
+		[](std::vector<std::string> params, config*cfg, motifList*ml, featureSet*features, seqList*trainseq, seqList*calseq, seqList*valseq) -> bool {
+			cfg->SVM_CascadeSize = (int)strtol(params[0].c_str(), 0, 10);
+			if(cfg->SVM_CascadeSize <= 0){
+				argSyntaxError();
+				return false;
+			}
+			return true;
+		}
+	},
+	{
+		// Argument
+		"-SVM:cascade:cold",
+		// Pass
+		1,
+		// Parameters
+		0,
+		// Documentation
+		"-SVM:cascade:cold",
+		{ "Trains the merged sets of cascade SVM training from scratch,",
+		  "instead of from the coefficients of their support vectors." },
+		// Code
+		[](std::vector<std::string> params, config*cfg, motifList*ml, featureSet*features, seqList*trainseq, seqList*calseq, seqList*valseq) -> bool {
+			cfg->SVM_CascadeWarmStart = false;
+			return true;
+		}
+	},
 	{
 		// Argument
 		"-RF:trees",
@@ -1342,8 +1587,11 @@ cmdArg argumentTypes[] = {
 		1,
 		// Documentation
 		"-threads VALUE",
-		{ "Sets the number of threads to use (currently only supported by",
-		  "RF-based models)." },
+		{ "Sets the number of threads to use (default: 8). Threads are used",
+		  "by RF-based models, for SVM kernel computation during training,",
+		  "for training the subsets of cascade SVM training (-SVM:cascade),",
+		  "and for feature extraction and training of MOCCA motif occurrence",
+		  "classifiers. Use -threads 1 for single-threaded training." },
 		// Code
 		[](std::vector<std::string> params, config*cfg, motifList*ml, featureSet*features, seqList*trainseq, seqList*calseq, seqList*valseq) -> bool {
 			cfg->nThreads = (int)strtol(params[0].c_str(), 0, 10);
@@ -2232,7 +2480,7 @@ sequenceClassifier*constructClassifier(motifList*motifs,featureSet*features,seqL
 		default:cmdError("Invalid classifier.");return 0;
 	}
 	if(!cls)return 0;
-	if(!trainseq||!trainseq->nseq){
+	if((!trainseq||!trainseq->nseq)&&!cfg->featuresImportPath.length()){
 		cmdError("No training sequences specified.");
 		delete cls;
 		return 0;
@@ -2270,7 +2518,7 @@ bool runPipeline(motifList*&motifs,featureSet*&features,seqList*&trainseq,seqLis
 		}
 		
 		cmdSection("Validation");
-		if(cfg->validate){
+		if(cfg->validate&&trainseq->nseq){
 			autofree<validationPair>vp((validationPair*)0);
 			int nvp=0;
 			if(!cls.ptr->getValidationTable(trainseq,vp.ptr,nvp))return false;
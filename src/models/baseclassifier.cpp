@@ -12,59 +12,250 @@
 #include "../sequencelist.hpp"
 #include "baseclassifier.hpp"
 
+#ifndef WINDOWS
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////////
 // Base classifiers
 //	These classifiers only classify vectors of values.
 
-baseClassifierSmp::baseClassifierSmp(double*v,seqClass*c,double e){
-	cls = c;
-	vecl = 0;
-	clsE = e;
+trainingMatrix::trainingMatrix(int nc,trainingLayout l,bool s){
+	layout=l;
+	single=s&&l!=trainingLayout_Nodes;
+	sparse=false;
+	nrows=0;
+	ncols=nc;
+	cap=0;
+	chunkSize=0;
+	chunkUsed=0;
+	source=0;
 }
 
-baseClassifierSmp*baseClassifierSmp::create(double*v,int vl,seqClass*c){
-	if(!v||!c){
-		cmdError("Invalid training example.");
-		return 0;
-	}
-	double e = c->flag?1.0:-1.0;
-	baseClassifierSmp*r = new baseClassifierSmp(v,c,e);
+trainingMatrix::~trainingMatrix(){
+	for(void*c: chunks)free(c);
+	if(source)delete source;
+}
+
+trainingMatrix*trainingMatrix::create(int nc,trainingLayout l,bool s){
+	trainingMatrix*r=new trainingMatrix(nc,l,s);
 	if(!r){
 		outOfMemory();
 		return 0;
 	}
-	r->vec.resize((size_t)vl);
-	if(!r->vec.ptr){
-		delete r;
-		return 0;
+	return r;
+}
+
+void*trainingMatrix::allocRow(size_t n){
+	if(!chunks.size()||chunkUsed+n>chunkSize){
+		size_t size=chunks.size()?min(chunkSize*2,(size_t)trainingMatrixChunkMax):trainingMatrixChunkMin;
+		if(size<n)size=n;
+		void*c=malloc(size);
+		if(!c){
+			outOfMemory();
+			return 0;
+		}
+		chunks.push_back(c);
+		chunkSize=size;
+		chunkUsed=0;
 	}
-	memcpy(r->vec.ptr,v,sizeof(double)*vl);
-	r->vecl = vl;
+	void*r=(char*)chunks.back()+chunkUsed;
+	// Keep rows aligned for double values.
+	chunkUsed+=(n+7)&~(size_t)7;
 	return r;
 }
 
+bool trainingMatrix::add(double*v,seqClass*c,double e){
+	if(!v||!c){
+		cmdError("Invalid training example.");
+		return false;
+	}
+	if(nrows&&sparse){
+		cmdError("Mixed dense and sparse training examples.");
+		return false;
+	}
+	if(layout==trainingLayout_Columns){
+		if(nrows==cap){
+			int ncap=cap?cap*2:256;
+			if(single){
+				if(!xf.resize((size_t)ncap*ncols))return false;
+				// Move columns to their new places, from the last.
+				for(int k=ncols-1;k>0;k--){
+					memmove(&xf.ptr[(size_t)k*ncap],&xf.ptr[(size_t)k*cap],sizeof(float)*nrows);
+				}
+			}else{
+				if(!x.resize((size_t)ncap*ncols))return false;
+				for(int k=ncols-1;k>0;k--){
+					memmove(&x.ptr[(size_t)k*ncap],&x.ptr[(size_t)k*cap],sizeof(double)*nrows);
+				}
+			}
+			cap=ncap;
+		}
+		for(int k=0;k<ncols;k++){
+			if(single)xf.ptr[(size_t)k*cap+nrows]=(float)v[k];
+			else x.ptr[(size_t)k*cap+nrows]=v[k];
+		}
+	}else if(layout==trainingLayout_Nodes){
+		svm_node*r=(svm_node*)allocRow(sizeof(svm_node)*(ncols+1));
+		if(!r)return false;
+		for(int k=0;k<ncols;k++){
+			r[k].index=k;
+			r[k].value=v[k];
+		}
+		r[ncols].index=-1;
+		r[ncols].value=0;
+		rows.push_back(r);
+	}else if(single){
+		float*r=(float*)allocRow(sizeof(float)*ncols);
+		if(!r)return false;
+		for(int k=0;k<ncols;k++)r[k]=(float)v[k];
+		rows.push_back(r);
+	}else{
+		double*r=(double*)allocRow(sizeof(double)*ncols);
+		if(!r)return false;
+		memcpy(r,v,sizeof(double)*ncols);
+		rows.push_back(r);
+	}
+	classes.push_back(c);
+	values.push_back(e);
+	nrows++;
+	return true;
+}
+
+bool trainingMatrix::addSparse(svm_node*v,int nnz,seqClass*c,double e){
+	if(!v||!c||nnz<0){
+		cmdError("Invalid training example.");
+		return false;
+	}
+	if(layout==trainingLayout_Columns){
+		std::vector<double> d(ncols,0.);
+		for(int i=0;i<nnz;i++)d[v[i].index]=v[i].value;
+		return add(d.data(),c,e);
+	}
+	if(nrows&&!sparse){
+		cmdError("Mixed dense and sparse training examples.");
+		return false;
+	}
+	svm_node*r=(svm_node*)allocRow(sizeof(svm_node)*(nnz+1));
+	if(!r)return false;
+	memcpy(r,v,sizeof(svm_node)*nnz);
+	r[nnz].index=-1;
+	r[nnz].value=0;
+	rows.push_back(r);
+	classes.push_back(c);
+	values.push_back(e);
+	sparse=true;
+	nrows++;
+	return true;
+}
+
+bool trainingMatrix::addView(featureMatrix*fm){
+	if(layout!=trainingLayout_Rows||single||sparse||source)return false;
+	int n=fm->getNRows();
+	rows.reserve(rows.size()+n);
+	classes.reserve(classes.size()+n);
+	values.reserve(values.size()+n);
+	for(int r=0;r<n;r++){
+		seqClass*c=fm->classes[fm->labels[r]];
+		rows.push_back(fm->getRow(r));
+		classes.push_back(c);
+		values.push_back(c->flag?1.0:-1.0);
+	}
+	nrows+=n;
+	source=fm;
+	return true;
+}
+
+double*trainingMatrix::getVector(int r,double*buf){
+	if(layout==trainingLayout_Columns){
+		for(int k=0;k<ncols;k++)buf[k]=getColumnValue(r,k);
+		return buf;
+	}
+	if(sparse||layout==trainingLayout_Nodes){
+		for(int k=0;k<ncols;k++)buf[k]=0;
+		for(svm_node*n=getNodes(r);n->index!=-1;n++)buf[n->index]=n->value;
+		return buf;
+	}
+	if(single){
+		float*f=(float*)rows[r];
+		for(int k=0;k<ncols;k++)buf[k]=f[k];
+		return buf;
+	}
+	return (double*)rows[r];
+}
+
 baseClassifier::baseClassifier(int nf){
 	nFeatures=nf;
 	threshold=0.0;
 	trained=false;
+	keepTrainingExamples=false;
+	trainingExampleLayout=trainingLayout_Rows;
+	nReleasedExamples=0;
 }
 
-baseClassifierSmp*baseClassifier::addTrain(double*v,int vl,seqClass*c){
+bool baseClassifier::initTrainingExamples(){
+	if(trainingExamples.ptr)return true;
+	trainingExamples.ptr=trainingMatrix::create(nFeatures,trainingExampleLayout,getConfiguration()->singleFeatures);
+	return trainingExamples.ptr!=0;
+}
+
+bool baseClassifier::addTrain(double*v,int vl,seqClass*c){
 	if(vl!=nFeatures){
 		cmdError("Training vector of incorrect size.");
 		cout << t_indent << vl << " != " << nFeatures << "\n";
-		return 0;
+		return false;
+	}
+	if(!initTrainingExamples())return false;
+	return trainingExamples.ptr->add(v,c,c&&c->flag?1.0:-1.0);
+}
+
+bool baseClassifier::addTrainV(double*v,int vl,seqClass*c,double val){
+	if(!addTrain(v,vl,c))return false;
+	trainingExamples.ptr->values.back()=val;
+	return true;
+}
+
+bool baseClassifier::addTrainSparse(svm_node*v,int nnz,int vl,seqClass*c){
+	if(vl!=nFeatures){
+		cmdError("Training vector of incorrect size.");
+		cout << t_indent << vl << " != " << nFeatures << "\n";
+		return false;
+	}
+	if(!initTrainingExamples())return false;
+	return trainingExamples.ptr->addSparse(v,nnz,c,c&&c->flag?1.0:-1.0);
+}
+
+bool baseClassifier::addTrainMatrix(featureMatrix*fm){
+	autodelete<featureMatrix> f(fm);
+	if(fm->getNCols()!=nFeatures){
+		cmdError("Training vector of incorrect size.");
+		cout << t_indent << fm->getNCols() << " != " << nFeatures << "\n";
+		return false;
+	}
+	if(!initTrainingExamples())return false;
+	if(trainingExamples.ptr->addView(fm)){
+		f.disown();
+		return true;
+	}
+	for(int r=0;r<fm->getNRows();r++){
+		if(!trainingExamples.ptr->add(fm->getRow(r),fm->classes[fm->labels[r]],fm->classes[fm->labels[r]]->flag?1.0:-1.0))
+			return false;
 	}
-	baseClassifierSmp*t = baseClassifierSmp::create(v,vl,c);
-	if(!t)return 0;
-	trainingExamples.push_back(t);
-	return t;
+	return true;
+}
+
+int baseClassifier::getNTrainingExamples(){
+	return trainingExamples.ptr?trainingExamples.ptr->nrows:nReleasedExamples;
 }
 
-baseClassifierSmp*baseClassifier::addTrainV(double*v,int vl,seqClass*c,double val){
-	baseClassifierSmp*t=addTrain(v,vl,c);
-	t->clsE=val;
-	return t;
+seqClass*baseClassifier::getTrainingClass(int i){
+	return trainingExamples.ptr->classes[i];
+}
+
+double*baseClassifier::getTrainingVector(int i,double*buf){
+	return trainingExamples.ptr->getVector(i,buf);
 }
 
 double baseClassifier::apply(double*v,int vl){
@@ -79,6 +270,47 @@ double baseClassifier::apply(double*v,int vl){
 	return do_apply(v)-threshold;
 }
 
+double baseClassifier::applySparse(svm_node*v,int vl){
+	if(!trained){
+		cmdWarning("Tried to apply untrained classifier.");
+		return -1;
+	}
+	if(vl!=nFeatures){
+		cmdWarning("Vector to classify is of incorrect size.");
+		return -1;
+	}
+	return do_applySparse(v)-threshold;
+}
+
+bool baseClassifier::applyBatch(double*m,int n,int vl,double*out){
+	if(!trained){
+		cmdWarning("Tried to apply untrained classifier.");
+		return false;
+	}
+	if(vl!=nFeatures){
+		cmdWarning("Vectors to classify are of incorrect size.");
+		return false;
+	}
+	do_applyBatch(m,n,out);
+	for(int r=0;r<n;r++)out[r]-=threshold;
+	return true;
+}
+
+void baseClassifier::do_applyBatch(double*m,int n,double*out){
+	for(int r=0;r<n;r++,m+=nFeatures)
+		out[r]=do_apply(m);
+}
+
+double baseClassifier::do_applySparse(svm_node*v){
+	if(!denseVec.ptr){
+		if(!denseVec.resize(nFeatures))return 0;
+	}
+	denseVec.fill(nFeatures,0);
+	for(;v->index!=-1;v++)
+		denseVec[v->index]=v->value;
+	return do_apply(denseVec.ptr);
+}
+
 bool baseClassifier::train(){
 	if(trained){
 		cmdError("Classifier already trained.");
@@ -88,15 +320,276 @@ bool baseClassifier::train(){
 		return false;
 	}
 	trained=true;
+	finalize();
 	return true;
 }
 
+void baseClassifier::finalize(){
+	if(keepTrainingExamples)return;
+	releaseTrainingExamples();
+}
+
+void baseClassifier::releaseTrainingExamples(){
+	if(!trainingExamples.ptr)return;
+	nReleasedExamples=trainingExamples.ptr->nrows;
+	delete trainingExamples.disown();
+}
+
 bool baseClassifier::exportAnalysisData(FILE*f, char*title, char*indent){
 	cmdError("Model export has not yet been implemented for this classifier.");
 	return false;
 }
 
 
+////////////////////////////////////////////////////////////////////////////////////
+// Feature matrix store
+
+featureMatrix::featureMatrix(){
+	mem=0;
+	memSize=0;
+	mapped=false;
+	header=0;
+	labels=0;
+	data=0;
+}
+
+featureMatrix::~featureMatrix(){
+	if(!mem)return;
+	#ifndef WINDOWS
+	if(mapped){
+		munmap(mem,memSize);
+		return;
+	}
+	#endif
+	free(mem);
+}
+
+uint64_t featureMatrix::getHash(std::vector<std::string>&names,std::vector<long long>&settings){
+	// 64-bit FNV-1a
+	uint64_t h=14695981039346656037ULL;
+	for(auto&n: names){
+		for(size_t i=0;i<=n.length();i++){
+			h^=(unsigned char)n.c_str()[i];
+			h*=1099511628211ULL;
+		}
+	}
+	for(long long v: settings){
+		for(int i=0;i<8;i++){
+			h^=(unsigned char)(v>>(i*8));
+			h*=1099511628211ULL;
+		}
+	}
+	return h;
+}
+
+static inline int64_t featureMatrixAlign(int64_t o){
+	return (o+7)&~(int64_t)7;
+}
+
+bool featureMatrix::save(std::string path,uint64_t hash,std::vector<std::string>&names,baseClassifier*bc){
+	int ncols=(int)names.size();
+	size_t nrows=(size_t)bc->getNTrainingExamples();
+	if(bc->nFeatures!=ncols){
+		cmdError("Training vector of incorrect size.");
+		return false;
+	}
+	// Class table
+	std::vector<seqClass*> cls;
+	autofree<int32_t> lbl(nrows+1);
+	if(!lbl.ptr){
+		outOfMemory();
+		return false;
+	}
+	for(size_t r=0;r<nrows;r++){
+		seqClass*rc=bc->getTrainingClass((int)r);
+		size_t c=0;
+		for(;c<cls.size()&&cls[c]!=rc;c++);
+		if(c==cls.size())cls.push_back(rc);
+		lbl[r]=(int32_t)c;
+	}
+	// Layout
+	featureMatrixHeader h;
+	memset(&h,0,sizeof(featureMatrixHeader));
+	memcpy(h.magic,featureMatrixMagic,8);
+	h.hash=hash;
+	h.nrows=(int32_t)nrows;
+	h.ncols=ncols;
+	h.nclasses=(int32_t)cls.size();
+	int64_t o=sizeof(featureMatrixHeader);
+	h.oNames=o;
+	for(auto&n: names)o+=n.length()+1;
+	h.oClasses=o=featureMatrixAlign(o);
+	o+=sizeof(featureMatrixClass)*cls.size();
+	h.oClassNames=o;
+	for(seqClass*c: cls)o+=c->name.length()+1;
+	h.oLabels=o=featureMatrixAlign(o);
+	o+=sizeof(int32_t)*nrows;
+	h.oData=o=featureMatrixAlign(o);
+	o+=sizeof(double)*(int64_t)nrows*ncols;
+	h.size=o;
+	// Write
+	FILE*f=fopen(path.c_str(),"wb");
+	if(!f){
+		cmdError("Could not open file for writing.");
+		cout << t_indent << "Path: " << path << "\n";
+		return false;
+	}
+	autofree<double> row(ncols+1);
+	if(!row.ptr){
+		outOfMemory();
+		fclose(f);
+		return false;
+	}
+	char zero[8]={0,0,0,0,0,0,0,0};
+	int64_t p=0;
+	bool ok=fwrite(&h,sizeof(featureMatrixHeader),1,f)==1;
+	p+=sizeof(featureMatrixHeader);
+	for(auto&n: names){
+		ok=ok&&fwrite(n.c_str(),n.length()+1,1,f)==1;
+		p+=n.length()+1;
+	}
+	ok=ok&&fwrite(zero,1,h.oClasses-p,f)==(size_t)(h.oClasses-p);
+	for(seqClass*c: cls){
+		featureMatrixClass fc;
+		memset(&fc,0,sizeof(featureMatrixClass));
+		fc.cls=c->cls;
+		fc.flag=c->flag?1:0;
+		ok=ok&&fwrite(&fc,sizeof(featureMatrixClass),1,f)==1;
+	}
+	p=h.oClassNames;
+	for(seqClass*c: cls){
+		ok=ok&&fwrite(c->name.c_str(),c->name.length()+1,1,f)==1;
+		p+=c->name.length()+1;
+	}
+	ok=ok&&fwrite(zero,1,h.oLabels-p,f)==(size_t)(h.oLabels-p);
+	if(nrows)ok=ok&&fwrite(lbl.ptr,sizeof(int32_t),nrows,f)==nrows;
+	p=h.oLabels+sizeof(int32_t)*nrows;
+	ok=ok&&fwrite(zero,1,h.oData-p,f)==(size_t)(h.oData-p);
+	for(size_t r=0;r<nrows;r++){
+		double*v=bc->getTrainingVector((int)r,row.ptr);
+		ok=ok&&fwrite(v,sizeof(double),ncols,f)==(size_t)ncols;
+	}
+	if(fclose(f))ok=false;
+	if(!ok){
+		cmdError("Failed writing feature matrix.");
+		cout << t_indent << "Path: " << path << "\n";
+		return false;
+	}
+	return true;
+}
+
+featureMatrix*featureMatrix::load(std::string path){
+	autodelete<featureMatrix> r(new featureMatrix());
+	if(!r.ptr){
+		outOfMemory();
+		return 0;
+	}
+	#ifndef WINDOWS
+	int fd=open(path.c_str(),O_RDONLY);
+	if(fd<0){
+		cmdError("Could not open feature matrix file.");
+		cout << t_indent << "Path: " << path << "\n";
+		return 0;
+	}
+	struct stat st;
+	if(fstat(fd,&st)||st.st_size<(off_t)sizeof(featureMatrixHeader)){
+		close(fd);
+		cmdError("Invalid feature matrix file.");
+		cout << t_indent << "Path: " << path << "\n";
+		return 0;
+	}
+	r.ptr->memSize=(size_t)st.st_size;
+	void*m=mmap(0,r.ptr->memSize,PROT_READ,MAP_PRIVATE,fd,0);
+	close(fd);
+	if(m==MAP_FAILED){
+		cmdError("Could not map feature matrix file.");
+		cout << t_indent << "Path: " << path << "\n";
+		return 0;
+	}
+	r.ptr->mem=(char*)m;
+	r.ptr->mapped=true;
+	#else
+	FILE*f=fopen(path.c_str(),"rb");
+	if(!f){
+		cmdError("Could not open feature matrix file.");
+		cout << t_indent << "Path: " << path << "\n";
+		return 0;
+	}
+	fseek(f,0,SEEK_END);
+	long fs=ftell(f);
+	fseek(f,0,SEEK_SET);
+	if(fs<(long)sizeof(featureMatrixHeader)){
+		fclose(f);
+		cmdError("Invalid feature matrix file.");
+		cout << t_indent << "Path: " << path << "\n";
+		return 0;
+	}
+	r.ptr->memSize=(size_t)fs;
+	r.ptr->mem=(char*)malloc(r.ptr->memSize);
+	if(!r.ptr->mem){
+		fclose(f);
+		outOfMemory();
+		return 0;
+	}
+	if(fread(r.ptr->mem,1,r.ptr->memSize,f)!=r.ptr->memSize){
+		fclose(f);
+		cmdError("Failed reading feature matrix file.");
+		return 0;
+	}
+	fclose(f);
+	#endif
+	char*mem=r.ptr->mem;
+	int64_t size=(int64_t)r.ptr->memSize;
+	featureMatrixHeader*h=r.ptr->header=(featureMatrixHeader*)mem;
+	if(memcmp(h->magic,featureMatrixMagic,8)||h->size!=size||h->nrows<0||h->ncols<=0||h->nclasses<0
+		||h->oNames<(int64_t)sizeof(featureMatrixHeader)||h->oClasses<h->oNames||h->oClassNames<h->oClasses+(int64_t)sizeof(featureMatrixClass)*h->nclasses
+		||h->oLabels<h->oClassNames||h->oData<h->oLabels+(int64_t)sizeof(int32_t)*h->nrows
+		||h->oData+(int64_t)sizeof(double)*h->nrows*h->ncols!=size||(h->oData&7)||(h->oLabels&3)){
+		cmdError("Invalid feature matrix file.");
+		cout << t_indent << "Path: " << path << "\n";
+		return 0;
+	}
+	// Feature names
+	char*c=mem+h->oNames;
+	for(int i=0;i<h->ncols;i++){
+		char*e=(char*)memchr(c,0,mem+h->oClasses-c);
+		if(!e){
+			cmdError("Invalid feature matrix file.");
+			return 0;
+		}
+		r.ptr->names.push_back(std::string(c));
+		c=e+1;
+	}
+	// Classes
+	featureMatrixClass*fc=(featureMatrixClass*)(mem+h->oClasses);
+	c=mem+h->oClassNames;
+	for(int i=0;i<h->nclasses;i++,fc++){
+		char*e=(char*)memchr(c,0,mem+h->oLabels-c);
+		if(!e){
+			cmdError("Invalid feature matrix file.");
+			return 0;
+		}
+		seqClass*sc=getSeqClassByValue(fc->cls);
+		if(!sc||sc->flag!=(fc->flag!=0)){
+			cmdError("Feature matrix class not registered.");
+			cout << t_indent << "Class: " << c << " (" << fc->cls << ")\n";
+			return 0;
+		}
+		r.ptr->classes.push_back(sc);
+		c=e+1;
+	}
+	r.ptr->labels=(int32_t*)(mem+h->oLabels);
+	for(int i=0;i<h->nrows;i++){
+		if(r.ptr->labels[i]<0||r.ptr->labels[i]>=h->nclasses){
+			cmdError("Invalid feature matrix file.");
+			return 0;
+		}
+	}
+	r.ptr->data=(double*)(mem+h->oData);
+	return r.disown();
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////////
 // Log-odds classifier
 //	Works similarly to the base classifier in the PREdictor.
@@ -138,14 +631,32 @@ double logoddsClassifier::getWeight(int i){
 }
 
 bool logoddsClassifier::do_train(){
-	for(baseClassifierSmp*t: trainingExamples.v){
+	trainingMatrix*tm=trainingExamples.ptr;
+	int ntrain=getNTrainingExamples();
+	autofree<double> buf((size_t)nFeatures+1);
+	if(!buf.ptr){
+		outOfMemory();
+		return false;
+	}
+	for(int l=0;l<ntrain;l++){
+		bool flag=tm->classes[l]->flag;
+		if(tm->sparse){
+			// Zero values only contribute to the example counts.
+			if(flag)nP+=nFeatures;
+			else nN+=nFeatures;
+			double*c=flag?cP.ptr:cN.ptr;
+			for(svm_node*v=tm->getNodes(l);v->index!=-1;v++)
+				c[v->index]+=v->value;
+			continue;
+		}
+		double*vec=tm->getVector(l,buf.ptr);
 		for(int i=0;i<nFeatures;i++){
-			if(t->cls->flag){
+			if(flag){
 				nP++;
-				cP[i]+=t->vec[i];
+				cP[i]+=vec[i];
 			}else{
 				nN++;
-				cN[i]+=t->vec[i];
+				cN[i]+=vec[i];
 			}
 		}
 	}
@@ -208,6 +719,24 @@ double logoddsClassifier::do_apply(double*vec){
 	return r;
 }
 
+void logoddsClassifier::do_applyBatch(double*m,int n,double*out){
+	for(int r=0;r<n;r++)out[r]=0;
+	for(int i=0;i<nFeatures;i++){
+		double w=weights[i];
+		double*v=&m[i];
+		for(int r=0;r<n;r++,v+=nFeatures)
+			out[r]+=(*v)*w;
+	}
+}
+
+double logoddsClassifier::do_applySparse(svm_node*v){
+	double r=0;
+	for(;v->index!=-1;v++){
+		r+=v->value*weights[v->index];
+	}
+	return r;
+}
+
 void logoddsClassifier::printInfo(char*header){
 	cout << t_indent << header << "\n";
 	cout << t_indent << t_indent << "Weights:\n";
@@ -244,6 +773,7 @@ bool logoddsClassifier::exportAnalysisData(FILE*f, char*title, char*indent){
 //	Implements feature value scaling internally.
 
 fastSVMClassifier::fastSVMClassifier(int type,int nf,std::string _name):baseClassifier(nf){
+	trainingExampleLayout=trainingLayout_Nodes;
 	memset(&svmprob,0,sizeof(svm_problem));
 	config*cfg=getConfiguration();
 	struct svm_parameter param={
@@ -252,7 +782,7 @@ fastSVMClassifier::fastSVMClassifier(int type,int nf,std::string _name):baseClas
 		2,		// degree
 		1.0/double(nf),// gamma
 		cfg->SVM_c0,// coef0
-		10000,	// cache size
+		cfg->SVM_CacheSize,	// cache size
 		1e-3,	// eps
 		cfg->SVM_C,	// C
 		0,		// nr_weight
@@ -268,55 +798,28 @@ fastSVMClassifier::fastSVMClassifier(int type,int nf,std::string _name):baseClas
 	svmvector=0;
 	nFeatures=nf;
 	mSVcoef=0;
+	batchCap=0;
+	sparse=false;
+	polyDegree=0;
+	polyB=0;
+	approxRank=0;
+	reducedSize=0;
+	reducedMeanError=0;
+	reducedAgreement=1;
+	fixedScaling=false;
+	approxMeanError=0;
+	approxAgreement=1;
+	dualCDIter=0;
+	cascadeSets=0;
+	cascadePasses=0;
 	name = _name;
 }
 
-bool fastSVMClassifier::IaddTrain(double*fv,double cls){
-	svmprob.l++;
-	svmprob.y=(double*)realloc(svmprob.y,sizeof(double)*svmprob.l);
-	if(!svmprob.y){
-		svmprob.l--;
-		outOfMemory();
-		return false;
-	}
-	svmprob.x=(svm_node**)realloc(svmprob.x,sizeof(svm_node*)*svmprob.l);
-	if(!svmprob.x){
-		svmprob.l--;
-		outOfMemory();
-		return false;
-	}
-	svm_node*nv=(svm_node*)malloc(sizeof(svm_node)*(nFeatures+1));
-	if(!nv){
-		svmprob.l--;
-		outOfMemory();
-		return false;
-	}
-	memset(nv,0,sizeof(svm_node)*(nFeatures+1));
-	nv[nFeatures].index=-1;
-	for(int i=0;i<nFeatures;i++){
-		nv[i].index=i;
-		nv[i].value=fv[i];
-	}
-	svmprob.x[svmprob.l-1]=nv;
-	svmprob.y[svmprob.l-1]=cls;
-	return true;
-}
-
 fastSVMClassifier::~fastSVMClassifier(){
-	if(mSVcoef){
-		for(int l=0;l<svmmdl->l;l++){
-			if(mSVcoef[l])free(mSVcoef[l]);
-		}
-		free(mSVcoef);
-	}
+	if(mSVcoef)free(mSVcoef);
 	if(svmmdl)svm_free_and_destroy_model(&svmmdl);
 	if(svmvector)free(svmvector);
-	if(svmprob.x){
-		for(int l=0;l<svmprob.l;l++){
-			if(svmprob.x[l])free(svmprob.x[l]);
-		}
-		free(svmprob.x);
-	}
+	if(svmprob.x)free(svmprob.x);
 	if(svmprob.y)free(svmprob.y);
 }
 
@@ -358,10 +861,13 @@ fastSVMClassifier*fastSVMClassifier::create(int type,int nf,std::string _name){
 	memset(r->svmvector,0,sizeof(svm_node)*(nf+1));
 	for(int l=0;l<nf;l++)r->svmvector[l].index=l;
 	r->svmvector[nf].index=-1;
+	r->sparseVec.resize(nf+1);
 	r->vMin.resize(nf);
 	r->vMax.resize(nf);
+	r->vHalfRange.resize(nf);
+	r->vScale.resize(nf);
 	r->SVcoef.resize(nf);
-	if(!r->vMin.ptr||!r->vMax.ptr||!r->SVcoef.ptr){
+	if(!r->vMin.ptr||!r->vMax.ptr||!r->vHalfRange.ptr||!r->vScale.ptr||!r->SVcoef.ptr||!r->sparseVec.ptr){
 		outOfMemory();
 		delete r;
 		return 0;
@@ -390,77 +896,1054 @@ void fastSVMClassifier::scaleVectorDoubleFloat(double*in,float*out){
 }
 
 bool fastSVMClassifier::do_train(){
-	// Make LibSVM vectors from stored double vectors
-	for(baseClassifierSmp*t: trainingExamples.v){
-		if(svmparam.svm_type==ONE_CLASS&&!t->cls->flag)continue;
-		if(!IaddTrain(t->vec,t->clsE)){
+	// Train directly on the stored LibSVM vectors, which are scaled in place
+	trainingMatrix*tm=trainingExamples.ptr;
+	int ntrain=getNTrainingExamples();
+	sparse=ntrain>0&&tm->sparse;
+	svmprob.x=(svm_node**)malloc(sizeof(svm_node*)*(ntrain+1));
+	svmprob.y=(double*)malloc(sizeof(double)*(ntrain+1));
+	if(!svmprob.x||!svmprob.y){
+		outOfMemory();
+		return false;
+	}
+	svmprob.l=0;
+	// Dense examples hold every feature, in order. Kernel columns are
+	// computed on all threads, unless trained alongside other models.
+	svmparam.dense=sparse?0:nFeatures;
+	svmparam.nr_thread=isParallelWorker()?1:getConfiguration()->nThreads;
+	for(int l=0;l<ntrain;l++){
+		if(svmparam.svm_type==ONE_CLASS&&!tm->classes[l]->flag)continue;
+		svmprob.x[svmprob.l]=tm->getNodes(l);
+		svmprob.y[svmprob.l]=tm->values[l];
+		svmprob.l++;
+	}
+	if(sparse){
+		// Scale by maximal absolute values, preserving zeros, and train
+		for(int x=0;x<nFeatures;x++)vMin[x]=vMax[x]=0;
+		for(int l=0;l<svmprob.l;l++){
+			for(svm_node*v=svmprob.x[l];v->index!=-1;v++){
+				if(v->value>vMax[v->index])vMax[v->index]=v->value;
+				if(v->value<vMin[v->index])vMin[v->index]=v->value;
+			}
+		}
+		for(int x=0;x<nFeatures;x++){
+			double m=max(-vMin[x],vMax[x]);
+			vHalfRange[x]=0;
+			vScale[x]=m!=0?1.0/m:0;
+		}
+		for(int l=0;l<svmprob.l;l++){
+			for(svm_node*v=svmprob.x[l];v->index!=-1;v++)
+				v->value*=vScale[v->index];
+		}
+		svmmdl=useDualCD()?trainDualCD():useCascade()?trainCascade():svm_train(&svmprob,&svmparam);
+		if(!svmmdl){
+			cmdError("LibSVM did not return a classifier");
 			return false;
 		}
+		if(!svmmdl->sv_coef){
+			svmparam.kernel_type=-1;
+			return true;
+		}
+		double*sv_coef=svmmdl->sv_coef[0];
+		if(svmparam.kernel_type==LINEAR){
+			for(int x=0;x<nFeatures;x++)SVcoef[x]=0;
+			for(int i=0;i<svmmdl->l;i++){
+				for(svm_node*sv=svmmdl->SV[i];sv->index!=-1;sv++)
+					SVcoef[sv->index]+=sv_coef[i]*sv->value;
+			}
+		}else if(svmparam.kernel_type==RBF){
+			if(!svNorm.resize(svmmdl->l))return false;
+			for(int i=0;i<svmmdl->l;i++){
+				double q=0;
+				for(svm_node*sv=svmmdl->SV[i];sv->index!=-1;sv++)
+					q+=sv->value*sv->value;
+				svNorm[i]=q;
+			}
+		}
+		return true;
 	}
 	// Scale and train
-	for(int l=0;l<svmprob.l;l++){
-		svm_node*v=svmprob.x[l];
+	if(!fixedScaling){
+		for(int l=0;l<svmprob.l;l++){
+			svm_node*v=svmprob.x[l];
+			for(int x=0;x<nFeatures;x++){
+				if(!l||v[x].value>vMax[x]){
+					vMax[x]=v[x].value;
+				}
+				if(!l||v[x].value<vMin[x]){
+					vMin[x]=v[x].value;
+				}
+			}
+		}
+		setScaling(vMin.ptr,vMax.ptr);
+	}
+	for(int l=0;l<svmprob.l;l++)scaleVector(svmprob.x[l]);
+	svmmdl=useDualCD()?trainDualCD():useCascade()?trainCascade():svm_train(&svmprob,&svmparam);
+	if(!svmmdl){
+		cmdError("LibSVM did not return a classifier");
+		return false;
+	}
+	if(!svmmdl->sv_coef){
+		svmparam.kernel_type=-1;
+		return true;
+	}
+	
+	if(svmparam.kernel_type==LINEAR){
+		double*sv_coef=svmmdl->sv_coef[0];
+		for(int l=0;l<nFeatures;l++){
+			double w=0;
+			for(int i=0;i<svmmdl->l;i++){
+				svm_node*sv=svmmdl->SV[i];
+				w+=sv_coef[i]*sv[l].value;
+			}
+			SVcoef[l]=w;
+		}
+	}else if(svmparam.kernel_type==POLY){
+		fVec.resize(nFeatures);
+		if(!fVec.ptr){
+			outOfMemory();
+			return false;
+		}
+		mSVcoef=(float**)malloc(sizeof(float*)*svmmdl->l);
+		if(!mSVcoef){
+			outOfMemory();
+			return false;
+		}
+		if(!mSVcoefData.resize((size_t)svmmdl->l*nFeatures+1))return false;
+		svm_node**sv=svmmdl->SV;
+		for(int l=0;l<svmmdl->l;l++,sv++){
+			mSVcoef[l]=&mSVcoefData.ptr[(size_t)l*nFeatures];
+			svm_node*csv=*sv;
+			float*v=mSVcoef[l];
+			for(int x=0;x<nFeatures;x++,csv++,v++){
+				*v=(float)csv->value;
+			}
+		}
+		if(!collapsePoly())return false;
+		if(!reduceSupportVectors())return false;
+	}else if(svmparam.kernel_type==RBF){
+		if(getConfiguration()->SVM_RBFApproxRank){
+			if(!approximateRBF())return false;
+		}else{
+			if(!reduceSupportVectors())return false;
+		}
+	}
+	
+	return true;
+}
+
+/*
+eigenSymmetric
+	Diagonalizes a symmetric n x n matrix A by cyclic Jacobi rotations.
+	A is overwritten, with the eigenvalues on its diagonal, and the
+	columns of V are set to the corresponding eigenvectors.
+*/
+static void eigenSymmetric(double*A,double*V,int n){
+	for(int i=0;i<n;i++)for(int j=0;j<n;j++)V[(size_t)i*n+j]=i==j?1:0;
+	for(int sweep=0;sweep<100;sweep++){
+		double off=0,diag=0;
+		for(int i=0;i<n;i++){
+			diag+=A[(size_t)i*n+i]*A[(size_t)i*n+i];
+			for(int j=i+1;j<n;j++)off+=A[(size_t)i*n+j]*A[(size_t)i*n+j];
+		}
+		if(off<=1e-30*diag||off==0)break;
+		for(int p=0;p<n;p++){
+			for(int q=p+1;q<n;q++){
+				double apq=A[(size_t)p*n+q];
+				if(apq==0)continue;
+				double theta=(A[(size_t)q*n+q]-A[(size_t)p*n+p])/(2.0*apq);
+				double t=(theta>=0?1.0:-1.0)/(fabs(theta)+sqrt(theta*theta+1.0));
+				double c=1.0/sqrt(t*t+1.0),s=t*c;
+				for(int k=0;k<n;k++){
+					double*ak=&A[(size_t)k*n];
+					double akp=ak[p],akq=ak[q];
+					ak[p]=c*akp-s*akq;
+					ak[q]=s*akp+c*akq;
+					double*vk=&V[(size_t)k*n];
+					double vkp=vk[p],vkq=vk[q];
+					vk[p]=c*vkp-s*vkq;
+					vk[q]=s*vkp+c*vkq;
+				}
+				double*ap=&A[(size_t)p*n],*aq=&A[(size_t)q*n];
+				for(int k=0;k<n;k++){
+					double apk=ap[k],aqk=aq[k];
+					ap[k]=c*apk-s*aqk;
+					aq[k]=s*apk+c*aqk;
+				}
+			}
+		}
+	}
+}
+
+bool fastSVMClassifier::useDualCD(){
+	config*cfg=getConfiguration();
+	if(cfg->SVM_DualCDMin<=0||svmprob.l<cfg->SVM_DualCDMin)return false;
+	if(svmparam.svm_type!=C_SVC&&svmparam.svm_type!=EPSILON_SVR)return false;
+	if(svmparam.kernel_type==LINEAR)return true;
+	return cfg->SVM_DualCDQuadratic&&svmparam.kernel_type==POLY&&svmparam.degree==2&&!sparse
+		&&nFeatures<=fastSVMDualCDMaxQuadratic&&svmparam.gamma>0&&svmparam.coef0>=0;
+}
+
+svm_model*fastSVMClassifier::trainDualCD(){
+	int n=nFeatures,l=svmprob.l;
+	bool quad=svmparam.kernel_type==POLY,svr=svmparam.svm_type==EPSILON_SVR;
+	double g=svmparam.gamma,c0=svmparam.coef0,C=svmparam.C,p=svmparam.p;
+	std::vector<double> y(l);
+	bool mixed=false;
+	for(int i=0;i<l;i++){
+		y[i]=svr?svmprob.y[i]:(svmprob.y[i]>0?1.0:-1.0);
+		if(y[i]!=y[0])mixed=true;
+	}
+	if(!svr&&!mixed)return svm_train(&svmprob,&svmparam);
+	/*
+		Explicit feature map of u = x-mu: a bias term, the linear terms,
+		and for quadratic kernels the pair terms i <= j, with
+		z(x).z(x') = 1 + K(u,u') - c0^2. Dense examples are centered on
+		their mean mu, which speeds up convergence and keeps the bias term
+		small, unless the kernel has no linear terms to absorb the shift.
+	*/
+	int nz=1+n+(quad?n*(n+1)/2:0);
+	double a=quad?sqrt(2.0*g*c0):1.0;
+	std::vector<double> w(nz,0),z(nz),QD(l),alpha(l,0),mu(n,0),u(n);
+	if(!sparse&&(!quad||c0>0)){
+		for(int i=0;i<l;i++){
+			for(int k=0;k<n;k++)mu[k]+=svmprob.x[i][k].value;
+		}
+		for(int k=0;k<n;k++)mu[k]/=l;
+	}
+	auto dot=[&](int i) -> double {
+		svm_node*x=svmprob.x[i];
+		if(sparse){
+			double r=w[0];
+			for(;x->index!=-1;x++)r+=w[1+x->index]*x->value;
+			return r;
+		}
+		for(int k=0;k<n;k++)u[k]=x[k].value-mu[k];
+		z[0]=1;
+		for(int k=0;k<n;k++)z[1+k]=a*u[k];
+		if(quad){
+			double*o=&z[1+n];
+			for(int j=0;j<n;j++){
+				double uj=g*u[j];
+				*o++=uj*u[j];
+				uj*=M_SQRT2;
+				for(int k=j+1;k<n;k++)*o++=uj*u[k];
+			}
+		}
+		double r=0;
+		for(int k=0;k<nz;k++)r+=w[k]*z[k];
+		return r;
+	};
+	// Adds d times the map of example i, which dense examples have in z
+	// from the preceding dot.
+	auto add=[&](int i,double d){
+		if(sparse){
+			w[0]+=d;
+			for(svm_node*x=svmprob.x[i];x->index!=-1;x++)w[1+x->index]+=d*x->value;
+			return;
+		}
+		for(int k=0;k<nz;k++)w[k]+=d*z[k];
+	};
+	for(int i=0;i<l;i++){
+		double q=0;
+		for(svm_node*x=svmprob.x[i];x->index!=-1;x++){
+			double v=x->value-mu[x->index];
+			q+=v*v;
+		}
+		QD[i]=1.0+a*a*q+(quad?g*g*q*q:0);
+	}
+	// Coordinate descent in random order, shrinking examples whose
+	// variables are at a bound and not expected to move, as in LIBLINEAR.
+	std::vector<int> index(l);
+	for(int i=0;i<l;i++)index[i]=i;
+	std::mt19937 rng((unsigned int)getConfiguration()->randSeed);
+	int active=l,iter=0;
+	double maxOld=HUGE_VAL,minOld=-HUGE_VAL,norm1Init=0;
+	for(;iter<fastSVMDualCDMaxIter;iter++){
+		std::shuffle(index.begin(),index.begin()+active,rng);
+		double maxNew=-HUGE_VAL,minNew=HUGE_VAL,norm1=0;
+		for(int s=0;s<active;s++){
+			int i=index[s];
+			double G=dot(i),ai=alpha[i],d;
+			bool shrink=false;
+			if(!svr){
+				// Hinge loss, 0 <= alpha_i <= C, w = sum alpha_i y_i z_i
+				G=G*y[i]-1.0;
+				double PG=0;
+				if(ai==0){
+					if(G>maxOld)shrink=true;
+					else if(G<0)PG=G;
+				}else if(ai==C){
+					if(G<minOld)shrink=true;
+					else if(G>0)PG=G;
+				}else PG=G;
+				if(!shrink){
+					maxNew=max(maxNew,PG);
+					minNew=min(minNew,PG);
+					if(fabs(PG)<=1e-12)continue;
+					alpha[i]=min(max(ai-G/QD[i],0.0),C);
+					d=(alpha[i]-ai)*y[i];
+				}
+			}else{
+				// Epsilon-insensitive loss, -C <= alpha_i <= C, w = sum alpha_i z_i
+				G-=y[i];
+				double Gp=G+p,Gn=G-p,H=QD[i],violation=0;
+				if(ai==0){
+					if(Gp<0)violation=-Gp;
+					else if(Gn>0)violation=Gn;
+					else if(Gp>maxOld&&Gn<-maxOld)shrink=true;
+				}else if(ai>=C){
+					if(Gp>0)violation=Gp;
+					else if(Gp<-maxOld)shrink=true;
+				}else if(ai<=-C){
+					if(Gn<0)violation=-Gn;
+					else if(Gn>maxOld)shrink=true;
+				}else if(ai>0)violation=fabs(Gp);
+				else violation=fabs(Gn);
+				if(!shrink){
+					maxNew=max(maxNew,violation);
+					norm1+=violation;
+					if(Gp<H*ai)d=-Gp/H;
+					else if(Gn>H*ai)d=-Gn/H;
+					else d=-ai;
+					if(fabs(d)<1e-12)continue;
+					alpha[i]=min(max(ai+d,-C),C);
+					d=alpha[i]-ai;
+				}
+			}
+			if(shrink){
+				active--;
+				std::swap(index[s],index[active]);
+				s--;
+				continue;
+			}
+			if(d!=0)add(i,d);
+		}
+		if(!iter)norm1Init=norm1;
+		bool converged=svr?norm1<=fastSVMDualCDEps*norm1Init:maxNew-minNew<=fastSVMDualCDEps;
+		if(converged){
+			if(active==l)break;
+			// Check the shrunk examples before stopping
+			active=l;
+			maxOld=HUGE_VAL;
+			minOld=-HUGE_VAL;
+			continue;
+		}
+		maxOld=maxNew>0?maxNew:HUGE_VAL;
+		minOld=minNew<0?minNew:-HUGE_VAL;
+	}
+	dualCDIter=iter+(iter<fastSVMDualCDMaxIter);
+	// Support vectors, with their coefficients, and the threshold, with
+	// the centering undone
+	std::vector<std::vector<double>> sv;
+	std::vector<double> coef;
+	double rho=-w[0];
+	if(!quad){
+		sv.push_back(std::vector<double>(w.begin()+1,w.begin()+1+n));
+		coef.push_back(1);
+		for(int k=0;k<n;k++)rho+=w[1+k]*mu[k];
+	}else{
+		/*
+			With A the quadratic form and v the linear terms, eigenvectors
+			u_k of A, with coefficients lambda_k/gamma^2, give the quadratic
+			terms, and linear terms 2*c0/gamma*lambda_k*u_k. The remaining
+			linear terms r are given by r/|r| and -r/|r|, with coefficients
+			+-|r|/(4*gamma*c0), as their quadratic terms cancel out.
+		*/
+		std::vector<double> A((size_t)n*n),V((size_t)n*n),r(n);
+		double*wq=&w[1+n];
+		for(int j=0;j<n;j++){
+			A[(size_t)j*n+j]=g*(*wq++);
+			for(int k=j+1;k<n;k++)A[(size_t)j*n+k]=A[(size_t)k*n+j]=g*M_SQRT1_2*(*wq++);
+		}
+		for(int k=0;k<n;k++){
+			r[k]=a*w[1+k];
+			rho+=r[k]*mu[k];
+			for(int x=0;x<n;x++){
+				r[k]-=2.0*A[(size_t)k*n+x]*mu[x];
+				rho-=A[(size_t)k*n+x]*mu[k]*mu[x];
+			}
+		}
+		eigenSymmetric(A.data(),V.data(),n);
+		double lmax=0;
+		for(int k=0;k<n;k++)lmax=max(lmax,fabs(A[(size_t)k*n+k]));
+		for(int k=0;k<n;k++){
+			double lk=A[(size_t)k*n+k];
+			if(fabs(lk)<=1e-12*lmax)continue;
+			std::vector<double> u(n);
+			for(int x=0;x<n;x++){
+				u[x]=V[(size_t)x*n+k];
+				r[x]-=2.0*c0/g*lk*u[x];
+			}
+			sv.push_back(u);
+			coef.push_back(lk/(g*g));
+			rho+=lk*c0*c0/(g*g);
+		}
+		double rn=0;
+		for(int x=0;x<n;x++)rn+=r[x]*r[x];
+		rn=sqrt(rn);
+		if(c0>0&&rn>0){
+			std::vector<double> u(n);
+			for(int x=0;x<n;x++)u[x]=r[x]/rn;
+			sv.push_back(u);
+			coef.push_back(rn/(4.0*g*c0));
+			for(int x=0;x<n;x++)u[x]=-u[x];
+			sv.push_back(u);
+			coef.push_back(-rn/(4.0*g*c0));
+		}
+	}
+	int nsv=(int)sv.size();
+	size_t nn=0;
+	for(auto&u:sv){
+		for(int x=0;x<n;x++)if(!sparse||u[x]!=0)nn++;
+		nn++;
+	}
+	svm_model*m=(svm_model*)malloc(sizeof(svm_model));
+	if(!m){
+		outOfMemory();
+		return 0;
+	}
+	memset(m,0,sizeof(svm_model));
+	m->param=svmparam;
+	m->nr_class=2;
+	m->l=nsv;
+	m->SV=(svm_node**)malloc(sizeof(svm_node*)*(nsv+1));
+	m->sv_coef=(double**)malloc(sizeof(double*));
+	if(m->sv_coef)m->sv_coef[0]=(double*)malloc(sizeof(double)*(nsv+1));
+	m->rho=(double*)malloc(sizeof(double));
+	if(!m->SV||!m->sv_coef||!m->sv_coef[0]||!m->rho||!svData.resize(nn+1)){
+		if(m->sv_coef&&!m->sv_coef[0]){
+			free(m->sv_coef);
+			m->sv_coef=0;
+		}
+		svm_free_and_destroy_model(&m);
+		outOfMemory();
+		return 0;
+	}
+	m->rho[0]=rho;
+	nn=0;
+	for(int k=0;k<nsv;k++){
+		m->SV[k]=&svData.ptr[nn];
+		m->sv_coef[0][k]=coef[k];
+		for(int x=0;x<n;x++){
+			if(sparse&&sv[k][x]==0)continue;
+			svData.ptr[nn].index=x;
+			svData.ptr[nn++].value=sv[k][x];
+		}
+		svData.ptr[nn].index=-1;
+		svData.ptr[nn++].value=0;
+	}
+	return m;
+}
+
+bool fastSVMClassifier::useCascade(){
+	config*cfg=getConfiguration();
+	if(cfg->SVM_CascadeSize<=0||svmprob.l<=cfg->SVM_CascadeSize)return false;
+	return svmparam.svm_type==C_SVC||svmparam.svm_type==EPSILON_SVR;
+}
+
+svm_model*fastSVMClassifier::trainCascade(){
+	config*cfg=getConfiguration();
+	int l=svmprob.l;
+	bool svr=svmparam.svm_type==EPSILON_SVR,warm=cfg->SVM_CascadeWarmStart;
+	/*
+		Trains on the examples idx, starting from the coefficients coef
+		if warm started. Unless keep is set, idx and coef are then set to
+		the support vectors and their coefficients, and otherwise coef is
+		set for all of idx. C-SVC sets with one class are left without
+		support vectors, and mdl is set to 0.
+	*/
+	int nSharing=1;		// Sets training concurrently, sharing the kernel cache
+	auto trainSet=[&](std::vector<int>&idx,std::vector<double>&coef,int nThreads,bool keep,svm_model*&mdl) -> bool {
+		int n=(int)idx.size();
+		std::vector<svm_node*> x(n);
+		std::vector<double> y(n);
+		bool mixed=svr&&n>0;
+		for(int k=0;k<n;k++){
+			x[k]=svmprob.x[idx[k]];
+			y[k]=svmprob.y[idx[k]];
+			if((y[k]>0)!=(y[0]>0))mixed=true;
+		}
+		mdl=0;
+		if(!mixed){
+			idx.clear();
+			coef.clear();
+			return true;
+		}
+		svm_problem prob={n,y.data(),x.data(),warm?coef.data():0};
+		svm_parameter param=svmparam;
+		param.nr_thread=nThreads;
+		param.cache_size=svmparam.cache_size/nSharing;
+		mdl=svm_train(&prob,&param);
+		if(!mdl){
+			cmdError("LibSVM did not return a classifier");
+			return false;
+		}
+		std::vector<int> sv(mdl->l);
+		if(keep)std::fill(coef.begin(),coef.end(),0.);
+		else coef.resize(mdl->l);
+		for(int k=0;k<mdl->l;k++){
+			int i=mdl->sv_indices[k]-1;
+			sv[k]=idx[i];
+			coef[keep?i:k]=mdl->sv_coef[0][k];
+			mdl->sv_indices[k]=sv[k]+1;
+		}
+		if(!keep)idx.swap(sv);
+		return true;
+	};
+	// Leaf subsets, dealt out from a random order, one class at a time
+	std::vector<int> order(l);
+	for(int i=0;i<l;i++)order[i]=i;
+	std::mt19937 rng((unsigned int)cfg->randSeed);
+	std::shuffle(order.begin(),order.end(),rng);
+	if(!svr)std::stable_partition(order.begin(),order.end(),[this](int i){ return svmprob.y[i]>0; });
+	int ns=(l+cfg->SVM_CascadeSize-1)/cfg->SVM_CascadeSize;
+	std::vector<std::vector<int>> sets(ns);
+	std::vector<std::vector<double>> coefs(ns);
+	for(int i=0;i<l;i++){
+		sets[i%ns].push_back(order[i]);
+		coefs[i%ns].push_back(0);
+	}
+	cascadeSets=ns;
+	// Train each layer of sets concurrently, and merge pairs of sets
+	svm_model*mdl=0;
+	for(;;){
+		ns=(int)sets.size();
+		std::vector<svm_model*> models(ns,(svm_model*)0);
+		std::vector<std::function<bool()>> tasks;
+		std::vector<size_t> costs;
+		int nThreads=ns>1?1:svmparam.nr_thread;
+		nSharing=isParallelWorker()?1:max(1,min(ns,cfg->nThreads));
+		for(int s=0;s<ns;s++){
+			tasks.push_back([&,s]() -> bool { return trainSet(sets[s],coefs[s],nThreads,false,models[s]); });
+			costs.push_back(sets[s].size());
+		}
+		bool ok=runParallel(tasks,costs,cfg->nThreads);
+		if(ok&&ns==1){
+			mdl=models[0];
+			break;
+		}
+		for(svm_model*m:models){
+			if(m)svm_free_and_destroy_model(&m);
+		}
+		if(!ok)return 0;
+		std::vector<std::vector<int>> msets;
+		std::vector<std::vector<double>> mcoefs;
+		for(int s=0;s<ns;s+=2){
+			msets.push_back(std::move(sets[s]));
+			mcoefs.push_back(std::move(coefs[s]));
+			if(s+1<ns){
+				msets.back().insert(msets.back().end(),sets[s+1].begin(),sets[s+1].end());
+				mcoefs.back().insert(mcoefs.back().end(),coefs[s+1].begin(),coefs[s+1].end());
+			}
+		}
+		sets.swap(msets);
+		coefs.swap(mcoefs);
+	}
+	if(!mdl){
+		cascadeSets=0;
+		return svm_train(&svmprob,&svmparam);
+	}
+	// Refine with the training examples violating the margin. Examples
+	// are kept once added, so that the set does not oscillate.
+	std::vector<char> inSet(l),violates(l);
+	for(cascadePasses=0;cascadePasses<fastSVMCascadeMaxPasses;cascadePasses++){
+		std::fill(inSet.begin(),inSet.end(),0);
+		for(int i:sets[0])inSet[i]=1;
+		double sign=!svr&&mdl->label&&mdl->label[0]<0?-1.0:1.0;
+		std::vector<std::function<bool()>> tasks;
+		std::vector<size_t> costs;
+		int nblocks=max(1,min(cfg->nThreads*4,l/1024));
+		for(int b=0;b<nblocks;b++){
+			int start=(int)((long long)l*b/nblocks),end=(int)((long long)l*(b+1)/nblocks);
+			tasks.push_back([&,start,end]() -> bool {
+				for(int i=start;i<end;i++){
+					violates[i]=0;
+					if(inSet[i])continue;
+					double d=-mdl->rho[0];
+					if(sparse)svm_predict_values(mdl,svmprob.x[i],&d);
+					else for(int k=0;k<mdl->l;k++)d+=mdl->sv_coef[0][k]*kernelScaled(svmprob.x[i],mdl->SV[k]);
+					d*=sign;
+					if(svr)violates[i]=fabs(svmprob.y[i]-d)>svmparam.p+svmparam.eps;
+					else violates[i]=(svmprob.y[i]>0?d:-d)<1.0-svmparam.eps;
+				}
+				return true;
+			});
+			costs.push_back(end-start);
+		}
+		runParallel(tasks,costs,cfg->nThreads);
+		int nv=0;
+		for(int i=0;i<l;i++){
+			if(!violates[i])continue;
+			sets[0].push_back(i);
+			coefs[0].push_back(0);
+			nv++;
+		}
+		if(!nv)break;
+		svm_free_and_destroy_model(&mdl);
+		if(!trainSet(sets[0],coefs[0],svmparam.nr_thread,true,mdl))return 0;
+		if(!mdl){
+			cascadeSets=0;
+			return svm_train(&svmprob,&svmparam);
+		}
+	}
+	return mdl;
+}
+
+bool fastSVMClassifier::needsSupportVectors(){
+	if(!svmmdl||!svmmdl->sv_coef||svmparam.kernel_type==LINEAR)return false;
+	// The weights of quadratic models are output from the support vectors.
+	if(!sparse&&svmparam.kernel_type==POLY&&svmparam.degree==2&&svmparam.coef0==0.0)return true;
+	return !polyDegree&&!approxRank&&!reducedSize;
+}
+
+void fastSVMClassifier::finalize(){
+	if(svmprob.x)free(svmprob.x);
+	if(svmprob.y)free(svmprob.y);
+	svmprob.x=0;
+	svmprob.y=0;
+	svmprob.l=0;
+	if(mSVcoef&&(polyDegree||reducedSize)){
+		free(mSVcoef);
+		mSVcoef=0;
+		free(mSVcoefData.disown());
+	}
+	// Models from trainDualCD already hold their support vectors in svData.
+	if(svmmdl&&svmmdl->SV&&!dualCDIter){
+		int nsv=svmmdl->l;
+		if(needsSupportVectors()){
+			size_t nn=0;
+			for(int l=0;l<nsv;l++){
+				svm_node*v=svmmdl->SV[l];
+				while(v->index!=-1)v++;
+				nn+=v-svmmdl->SV[l]+1;
+			}
+			if(!svData.resize(nn+1))return;
+			nn=0;
+			for(int l=0;l<nsv;l++){
+				svm_node*v=svmmdl->SV[l],*o=&svData.ptr[nn];
+				do{
+					svData.ptr[nn++]=*v;
+				}while((v++)->index!=-1);
+				svmmdl->SV[l]=o;
+			}
+		}else{
+			for(int l=0;l<nsv;l++)svmmdl->SV[l]=0;
+		}
+	}
+	baseClassifier::finalize();
+}
+
+bool fastSVMClassifier::approximateRBF(){
+	int n=nFeatures;
+	int D=getConfiguration()->SVM_RBFApproxRank;
+	if(!approxOmega.resize((size_t)D*n)||!approxPhase.resize(D)||!approxW.resize(D))return false;
+	/*
+		exp(-gamma*|x-y|^2) is the expectation of 2*cos(o.x+p)*cos(o.y+p),
+		with o ~ N(0,2*gamma) per dimension and p ~ U(0,2*pi). The model is
+		sum_l coef_l*K(x,sv_l) - rho ~ sum_d w_d*cos(o_d.x+p_d) - rho, with
+		w_d = 2/D * sum_l coef_l*cos(o_d.sv_l+p_d).
+	*/
+	std::mt19937 rng((unsigned int)getConfiguration()->randSeed);
+	std::normal_distribution<double> nd(0.0,sqrt(2.0*svmparam.gamma));
+	std::uniform_real_distribution<double> ud(0.0,2.0*acos(-1.0));
+	double*coef=svmmdl->sv_coef[0];
+	for(int d=0;d<D;d++){
+		double*o=&approxOmega[(size_t)d*n];
+		for(int x=0;x<n;x++)o[x]=nd(rng);
+		double p=ud(rng);
+		double w=0;
+		for(int l=0;l<svmmdl->l;l++){
+			svm_node*sv=svmmdl->SV[l];
+			double a=p;
+			for(int x=0;x<n;x++)a+=o[x]*sv[x].value;
+			w+=coef[l]*cos(a);
+		}
+		approxW[d]=2.0*w/double(D);
+		// Fold in scaling: o.x'+p = (o*s).x + (p + o.e)
+		for(int x=0;x<n;x++){
+			p-=o[x]*(vMin[x]+vHalfRange[x])*vScale[x];
+			o[x]*=vScale[x];
+		}
+		approxPhase[d]=p;
+	}
+	approxRank=D;
+	// Measure the error on (scaled) training examples.
+	int step=max(1,svmprob.l/fastSVMApproxErrorSamples);
+	int ns=0,nagree=0;
+	double err=0;
+	std::vector<double> v(n);
+	for(int l=0;l<svmprob.l;l+=step,ns++){
+		svm_node*sv=svmprob.x[l];
+		for(int x=0;x<n;x++){
+			// Unscale, as applyApproxRBF takes unscaled vectors
+			v[x]=vScale[x]!=0?sv[x].value/vScale[x]+vMin[x]+vHalfRange[x]:vMin[x];
+		}
+		double exact=applyExactScaled(sv);
+		double approx=applyApproxRBF(v.data());
+		err+=fabs(exact-approx);
+		if((exact>0)==(approx>0))nagree++;
+	}
+	approxMeanError=ns?err/ns:0;
+	approxAgreement=ns?double(nagree)/ns:1;
+	return true;
+}
+
+double fastSVMClassifier::applyApproxRBF(double*fv){
+	int n=nFeatures;
+	double r=-svmmdl->rho[0];
+	double*o=approxOmega.ptr;
+	for(int d=0;d<approxRank;d++,o+=n){
+		double a=approxPhase[d];
+		for(int x=0;x<n;x++)a+=o[x]*fv[x];
+		r+=approxW[d]*cos(a);
+	}
+	return r;
+}
+
+double fastSVMClassifier::applyExactScaled(svm_node*v){
+	double r=0;
+	double*coef=svmmdl->sv_coef[0];
+	for(int l=0;l<svmmdl->l;l++){
+		r+=kernelScaled(v,svmmdl->SV[l])*coef[l];
+	}
+	return r-svmmdl->rho[0];
+}
+
+double fastSVMClassifier::kernelScaled(svm_node*a,svm_node*b){
+	double r=0;
+	if(svmparam.kernel_type==RBF){
 		for(int x=0;x<nFeatures;x++){
-			if(!l||v[x].value>vMax[x]){
-				vMax[x]=v[x].value;
+			double tmp=a[x].value-b[x].value;
+			r+=tmp*tmp;
+		}
+		return exp(-svmparam.gamma*r);
+	}
+	for(int x=0;x<nFeatures;x++){
+		r+=a[x].value*b[x].value;
+	}
+	if(svmparam.kernel_type==POLY){
+		double k=svmparam.gamma*r+svmparam.coef0;
+		r=1;
+		for(int d=0;d<svmparam.degree;d++)r*=k;
+	}
+	return r;
+}
+
+/*
+solveCholesky
+	Solves A x = b for a symmetric positive definite n x n matrix A, which
+	is overwritten by its Cholesky factor. b is overwritten by x. Returns
+	false if A is not positive definite.
+*/
+static bool solveCholesky(double*A,double*b,int n){
+	for(int j=0;j<n;j++){
+		double*rj=&A[(size_t)j*n];
+		double d=rj[j];
+		for(int k=0;k<j;k++)d-=rj[k]*rj[k];
+		if(d<=0)return false;
+		d=sqrt(d);
+		rj[j]=d;
+		for(int i=j+1;i<n;i++){
+			double*ri=&A[(size_t)i*n];
+			double s=ri[j];
+			for(int k=0;k<j;k++)s-=ri[k]*rj[k];
+			ri[j]=s/d;
+		}
+	}
+	// L y = b, then L^T x = y
+	for(int i=0;i<n;i++){
+		double*ri=&A[(size_t)i*n];
+		double s=b[i];
+		for(int k=0;k<i;k++)s-=ri[k]*b[k];
+		b[i]=s/ri[i];
+	}
+	for(int i=n-1;i>=0;i--){
+		double s=b[i];
+		for(int k=i+1;k<n;k++)s-=A[(size_t)k*n+i]*b[k];
+		b[i]=s/A[(size_t)i*n+i];
+	}
+	return true;
+}
+
+bool fastSVMClassifier::reduceSupportVectors(){
+	double maxLoss=getConfiguration()->SVM_ReduceMaxLoss;
+	if(maxLoss<=0||sparse||approxRank||polyDegree)return true;
+	if(svmparam.kernel_type!=RBF&&svmparam.kernel_type!=POLY)return true;
+	int n=nFeatures,nsv=svmmdl->l;
+	int maxSize=min(fastSVMReduceMaxSize,nsv/2);
+	if(maxSize<fastSVMReduceMinSize)return true;
+	double*coef=svmmdl->sv_coef[0];
+	svm_node**SV=svmmdl->SV;
+	// Candidates: free support vectors, which lie on the margin, before
+	// those at the coefficient bound, in random order within each group.
+	double cMax=0;
+	for(int l=0;l<nsv;l++)cMax=max(cMax,fabs(coef[l]));
+	std::vector<int> order(nsv);
+	for(int l=0;l<nsv;l++)order[l]=l;
+	std::mt19937 rng((unsigned int)getConfiguration()->randSeed);
+	std::shuffle(order.begin(),order.end(),rng);
+	std::stable_partition(order.begin(),order.end(),[coef,cMax](int l){
+		return fabs(coef[l])<cMax*(1.0-1e-9);
+	});
+	// Decision values of the full model on a sample of training examples
+	int step=max(1,svmprob.l/fastSVMApproxErrorSamples);
+	std::vector<svm_node*> sample;
+	std::vector<double> exact;
+	for(int l=0;l<svmprob.l;l+=step){
+		sample.push_back(svmprob.x[l]);
+		exact.push_back(applyExactScaled(svmprob.x[l]));
+	}
+	int ns=(int)sample.size();
+	// Kernel values between candidates, and the projections of the full
+	// model onto the candidates, for the largest size tried. Smaller sets
+	// are prefixes of the candidate order, so they are filled in as the
+	// size grows.
+	std::vector<double> Kzz((size_t)maxSize*maxSize),Kzw(maxSize),A,beta;
+	int nDone=0;
+	for(int m=fastSVMReduceMinSize;m<=maxSize;m=(m<maxSize&&m*2>maxSize)?maxSize:m*2){
+		for(int i=nDone;i<m;i++){
+			svm_node*zi=SV[order[i]];
+			for(int j=0;j<=i;j++){
+				Kzz[(size_t)i*maxSize+j]=Kzz[(size_t)j*maxSize+i]=kernelScaled(zi,SV[order[j]]);
 			}
-			if(!l||v[x].value<vMin[x]){
-				vMin[x]=v[x].value;
+			double w=0;
+			for(int l=0;l<nsv;l++)w+=coef[l]*kernelScaled(zi,SV[l]);
+			Kzw[i]=w;
+		}
+		nDone=m;
+		// Least squares fit in feature space: (Kzz + ridge) beta = Kzw
+		A.resize((size_t)m*m);
+		beta.assign(Kzw.begin(),Kzw.begin()+m);
+		double trace=0;
+		for(int i=0;i<m;i++){
+			for(int j=0;j<m;j++)A[(size_t)i*m+j]=Kzz[(size_t)i*maxSize+j];
+			trace+=A[(size_t)i*m+i];
+		}
+		double ridge=1e-10*trace/m+1e-300;
+		for(int i=0;i<m;i++)A[(size_t)i*m+i]+=ridge;
+		if(!solveCholesky(A.data(),beta.data(),m)){
+			if(m==maxSize)break;
+			continue;
+		}
+		int nagree=0;
+		double err=0;
+		for(int s=0;s<ns;s++){
+			double r=-svmmdl->rho[0];
+			for(int i=0;i<m;i++)r+=beta[i]*kernelScaled(sample[s],SV[order[i]]);
+			err+=fabs(exact[s]-r);
+			if((exact[s]>0)==(r>0))nagree++;
+		}
+		double agreement=ns?double(nagree)/ns:1;
+		reducedTrials.push_back(std::make_pair(m,agreement));
+		if(1.0-agreement<=maxLoss){
+			if(!reducedZ.resize((size_t)m*n)||!reducedBeta.resize(m))return false;
+			for(int i=0;i<m;i++){
+				svm_node*zi=SV[order[i]];
+				for(int x=0;x<n;x++)reducedZ[(size_t)i*n+x]=zi[x];
+				reducedBeta[i]=beta[i];
+			}
+			reducedSize=m;
+			reducedMeanError=ns?err/ns:0;
+			reducedAgreement=agreement;
+			break;
+		}
+		if(m==maxSize)break;
+	}
+	return true;
+}
+
+double fastSVMClassifier::applyReduced(double*fv){
+	for(int i=0;i<nFeatures;i++){
+		svmvector[i].value=fv[i];
+	}
+	scaleVector(svmvector);
+	double r=-svmmdl->rho[0];
+	svm_node*z=reducedZ.ptr;
+	for(int i=0;i<reducedSize;i++,z+=nFeatures){
+		r+=reducedBeta[i]*kernelScaled(svmvector,z);
+	}
+	return r;
+}
+
+bool fastSVMClassifier::collapsePoly(){
+	int n=nFeatures;
+	int deg=svmparam.degree;
+	if(sparse||svmparam.kernel_type!=POLY||(deg!=2&&deg!=3))return true;
+	if(deg==3&&n>fastSVMCollapseMaxCubic)return true;
+	// Number of terms, compared to the cost of evaluating the support vectors
+	double nterms=double(n)*(n+1)/2+n;
+	if(deg==3)nterms+=double(n)*(n+1)*(n+2)/6;
+	if(nterms>=double(svmmdl->l)*n)return true;
+	/*
+		With d the dot product of the scaled vector x' and a support vector,
+		(gamma*d+c0)^deg is expanded into terms of order 0 to deg. The
+		coefficients are summed over support vectors as the constant b,
+		vector w, matrix Q and tensor T (cubic), in terms of x'. Scaling,
+		x'_i = s_i*x_i + e_i, is then folded in.
+	*/
+	double g=svmparam.gamma,c0=svmparam.coef0;
+	double*coef=svmmdl->sv_coef[0];
+	double cT=g*g*g;
+	double cQ=deg==2?g*g:3.0*g*g*c0;
+	double cW=deg==2?2.0*g*c0:3.0*g*c0*c0;
+	double cB=deg==2?c0*c0:c0*c0*c0;
+	std::vector<double> w(n,0),Q((size_t)n*n,0),T;
+	double b=-svmmdl->rho[0];
+	for(int l=0;l<svmmdl->l;l++){
+		svm_node*sv=svmmdl->SV[l];
+		b+=cB*coef[l];
+		for(int i=0;i<n;i++){
+			double ai=coef[l]*sv[i].value;
+			if(ai==0)continue;
+			w[i]+=cW*ai;
+			for(int j=i;j<n;j++)Q[(size_t)i*n+j]+=cQ*ai*sv[j].value;
+		}
+	}
+	if(deg==3){
+		T.assign((size_t)n*n*n,0);
+		for(int l=0;l<svmmdl->l;l++){
+			svm_node*sv=svmmdl->SV[l];
+			for(int i=0;i<n;i++){
+				double ai=coef[l]*sv[i].value;
+				if(ai==0)continue;
+				for(int j=i;j<n;j++){
+					double aij=ai*sv[j].value;
+					if(aij==0)continue;
+					double*t=&T[((size_t)i*n+j)*n];
+					for(int k=j;k<n;k++)t[k]+=cT*aij*sv[k].value;
+				}
+			}
+		}
+		// Make symmetric
+		for(int i=0;i<n;i++)for(int j=i;j<n;j++)for(int k=j;k<n;k++){
+			double v=T[((size_t)i*n+j)*n+k];
+			T[((size_t)i*n+k)*n+j]=v;
+			T[((size_t)j*n+i)*n+k]=v;
+			T[((size_t)j*n+k)*n+i]=v;
+			T[((size_t)k*n+i)*n+j]=v;
+			T[((size_t)k*n+j)*n+i]=v;
+		}
+	}
+	for(int i=0;i<n;i++)for(int j=0;j<i;j++)Q[(size_t)i*n+j]=Q[(size_t)j*n+i];
+	// Fold in scaling
+	std::vector<double> e(n),sc(n),Qe(n,0),Te,Tee(n,0);
+	for(int i=0;i<n;i++){
+		sc[i]=vScale[i];
+		e[i]=-(vMin[i]+vHalfRange[i])*vScale[i];
+	}
+	for(int i=0;i<n;i++)for(int j=0;j<n;j++)Qe[i]+=Q[(size_t)i*n+j]*e[j];
+	if(deg==3){
+		Te.assign((size_t)n*n,0);
+		for(int i=0;i<n;i++)for(int j=0;j<n;j++){
+			double*t=&T[((size_t)i*n+j)*n];
+			double v=0;
+			for(int k=0;k<n;k++)v+=t[k]*e[k];
+			Te[(size_t)i*n+j]=v;
+		}
+		for(int i=0;i<n;i++)for(int j=0;j<n;j++)Tee[i]+=Te[(size_t)i*n+j]*e[j];
+	}
+	polyB=b;
+	for(int i=0;i<n;i++){
+		polyB+=(w[i]+Qe[i]+Tee[i])*e[i];
+	}
+	if(!polyW.resize(n)||!polyP.resize((size_t)nterms))return false;
+	for(int i=0;i<n;i++){
+		polyW[i]=sc[i]*(w[i]+2.0*Qe[i]+3.0*Tee[i]);
+	}
+	double*p=polyP.ptr;
+	for(int i=0;i<n;i++){
+		for(int j=i;j<n;j++){
+			double q=Q[(size_t)i*n+j];
+			if(deg==3)q+=3.0*Te[(size_t)i*n+j];
+			*p++=(i==j?1.0:2.0)*sc[i]*sc[j]*q;
+			if(deg==3){
+				for(int k=j;k<n;k++){
+					double m=(i==j&&j==k)?1.0:((i==j||j==k)?3.0:6.0);
+					*p++=m*sc[i]*sc[j]*sc[k]*T[((size_t)i*n+j)*n+k];
+				}
 			}
 		}
 	}
-	for(int l=0;l<svmprob.l;l++)scaleVector(svmprob.x[l]);
-	svmmdl=svm_train(&svmprob,&svmparam);
-	if(!svmmdl){
-		cmdError("LibSVM did not return a classifier");
-		return false;
+	polyDegree=deg;
+	return true;
+}
+
+void fastSVMClassifier::setScaling(double*min,double*max){
+	for(int x=0;x<nFeatures;x++){
+		vMin[x]=min[x];
+		vMax[x]=max[x];
+		double range=vMax[x]-vMin[x];
+		vHalfRange[x]=range*0.5;
+		vScale[x]=range!=0?2.0/range:0;
 	}
-	if(!svmmdl->sv_coef){
-		svmparam.kernel_type=-1;
+	fixedScaling=true;
+}
+
+bool fastSVMClassifier::isKernelExpansion(){
+	if(!svmmdl||!svmmdl->sv_coef||!svmmdl->sv_indices||sparse||approxRank||reducedSize||polyDegree)return false;
+	return svmparam.kernel_type==RBF||svmparam.kernel_type==POLY;
+}
+
+bool fastSVMClassifier::getPolynomial(int&degree,double&b,double*w,double*&P){
+	if(!trained||sparse)return false;
+	P=0;
+	if(!svmmdl||svmparam.kernel_type==-1){
+		degree=1;
+		b=-threshold;
+		for(int i=0;i<nFeatures;i++)w[i]=0;
 		return true;
 	}
-	
 	if(svmparam.kernel_type==LINEAR){
-		double*sv_coef=svmmdl->sv_coef[0];
-		for(int l=0;l<nFeatures;l++){
-			double w=0;
-			for(int i=0;i<svmmdl->l;i++){
-				svm_node*sv=svmmdl->SV[i];
-				w+=sv_coef[i]*sv[l].value;
-			}
-			SVcoef[l]=w;
-		}
-	}else if(svmparam.kernel_type==POLY){
-		fVec.resize(nFeatures);
-		if(!fVec.ptr){
-			outOfMemory();
-			return false;
-		}
-		mSVcoef=(float**)malloc(sizeof(float*)*svmmdl->l);
-		if(!mSVcoef){
-			outOfMemory();
-			return false;
+		degree=1;
+		b=-svmmdl->rho[0]-threshold;
+		for(int i=0;i<nFeatures;i++){
+			w[i]=SVcoef[i]*vScale[i];
+			b-=SVcoef[i]*(vMin[i]+vHalfRange[i])*vScale[i];
 		}
-		svm_node**sv=svmmdl->SV;
-		for(int l=0;l<svmmdl->l;l++,sv++){
-			mSVcoef[l]=(float*)malloc(sizeof(float)*nFeatures);
-			if(!mSVcoef[l]){
-				outOfMemory();
-				return false;
-			}
-			svm_node*csv=*sv;
-			float*v=mSVcoef[l];
-			for(int x=0;x<nFeatures;x++,csv++,v++){
-				*v=(float)csv->value;
+		return true;
+	}
+	if(polyDegree==2){
+		degree=2;
+		b=polyB-threshold;
+		for(int i=0;i<nFeatures;i++)w[i]=polyW[i];
+		P=polyP.ptr;
+		return true;
+	}
+	return false;
+}
+
+double fastSVMClassifier::applyCollapsed(double*fv){
+	double r=polyB;
+	double*p=polyP.ptr;
+	for(int i=0;i<nFeatures;i++){
+		double ti=polyW[i];
+		for(int j=i;j<nFeatures;j++){
+			double tj=*p++;
+			if(polyDegree==3){
+				for(int k=j;k<nFeatures;k++)tj+=(*p++)*fv[k];
 			}
+			ti+=tj*fv[j];
 		}
+		r+=ti*fv[i];
 	}
-	
-	return true;
+	return r;
 }
 
 double fastSVMClassifier::do_apply(double*fv){
 	if(!svmmdl)return 0;
+	if(sparse){
+		svm_node*o=sparseVec.ptr;
+		for(int i=0;i<nFeatures;i++){
+			if(fv[i]==0)continue;
+			o->index=i;
+			o->value=fv[i]*vScale[i];
+			o++;
+		}
+		o->index=-1;
+		return applyScaledSparse(sparseVec.ptr);
+	}
+	if(reducedSize)return applyReduced(fv);
 	if(svmparam.kernel_type==-1){
 		return 0;
 	}else if(svmparam.kernel_type==LINEAR){
@@ -475,6 +1958,7 @@ double fastSVMClassifier::do_apply(double*fv){
 		return r-svmmdl->rho[0];
 		
 	}else if(svmparam.kernel_type==POLY){
+		if(polyDegree)return applyCollapsed(fv);
 		scaleVectorDoubleFloat(fv,fVec.ptr);
 		double r=0;
 		double kv;
@@ -506,6 +1990,7 @@ double fastSVMClassifier::do_apply(double*fv){
 		}
 		return r-svmmdl->rho[0];
 	}else if(svmparam.kernel_type==RBF){
+		if(approxRank)return applyApproxRBF(fv);
 		for(int i=0;i<nFeatures;i++){
 			svmvector[i].value=fv[i];
 		}
@@ -530,6 +2015,135 @@ double fastSVMClassifier::do_apply(double*fv){
 	return 0;
 }
 
+double fastSVMClassifier::do_applySparse(svm_node*v){
+	if(!sparse)return baseClassifier::do_applySparse(v);
+	if(!svmmdl)return 0;
+	svm_node*o=sparseVec.ptr;
+	for(;v->index!=-1;v++,o++){
+		o->index=v->index;
+		o->value=v->value*vScale[v->index];
+	}
+	o->index=-1;
+	return applyScaledSparse(sparseVec.ptr);
+}
+
+double fastSVMClassifier::applyScaledSparse(svm_node*v){
+	if(svmparam.kernel_type==-1){
+		return 0;
+	}else if(svmparam.kernel_type==LINEAR){
+		double r=0;
+		for(;v->index!=-1;v++){
+			r+=v->value*SVcoef[v->index];
+		}
+		return r-svmmdl->rho[0];
+	}else if(svmparam.kernel_type==POLY||svmparam.kernel_type==RBF){
+		double vnorm=0;
+		for(svm_node*a=v;a->index!=-1;a++)vnorm+=a->value*a->value;
+		double r=0;
+		double*coef=svmmdl->sv_coef[0];
+		for(int l=0;l<svmmdl->l;l++){
+			// Sparse dot product, merging by index
+			svm_node*a=v,*b=svmmdl->SV[l];
+			double dot=0;
+			while(a->index!=-1&&b->index!=-1){
+				if(a->index==b->index){
+					dot+=a->value*b->value;
+					a++,b++;
+				}else if(a->index<b->index)a++;
+				else b++;
+			}
+			if(svmparam.kernel_type==POLY){
+				double kv=svmparam.gamma*dot+svmparam.coef0;
+				if(svmparam.degree==2)r+=kv*kv*coef[l];
+				else if(svmparam.degree==3)r+=kv*kv*kv*coef[l];
+			}else{
+				double qdist=vnorm+svNorm[l]-2.0*dot;
+				r+=exp(-svmparam.gamma*qdist)*coef[l];
+			}
+		}
+		return r-svmmdl->rho[0];
+	}
+	cmdWarning("Unsupported kernel");
+	return 0;
+}
+
+void fastSVMClassifier::do_applyBatch(double*m,int n,double*out){
+	if(!svmmdl||svmparam.kernel_type==-1){
+		for(int r=0;r<n;r++)out[r]=0;
+		return;
+	}
+	if(sparse||polyDegree||approxRank||reducedSize||n<fastSVMBatchMinRows||(svmparam.kernel_type!=LINEAR&&svmparam.kernel_type!=POLY&&svmparam.kernel_type!=RBF)){
+		baseClassifier::do_applyBatch(m,n,out);
+		return;
+	}
+	if(n>batchCap){
+		if(!batchF.resize((size_t)n*nFeatures)||!batchD.resize((size_t)n*nFeatures)||!batchT.resize(n)){
+			batchCap=0;
+			baseClassifier::do_applyBatch(m,n,out);
+			return;
+		}
+		batchCap=n;
+	}
+	/*
+		Scale into a column-major matrix, so that the inner loops run over
+		windows. Per row, operations are carried out in the same order as
+		in do_apply, so results are identical.
+	*/
+	for(int x=0;x<nFeatures;x++){
+		double vmin=vMin[x],hr=vHalfRange[x],s=vScale[x];
+		double*in=&m[x];
+		double*cd=&batchD[(size_t)x*n];
+		float*cf=&batchF[(size_t)x*n];
+		for(int r=0;r<n;r++,in+=nFeatures){
+			cd[r]=((*in)-vmin-hr)*s;
+			cf[r]=float(cd[r]);
+		}
+	}
+	double rho=svmmdl->rho[0];
+	for(int r=0;r<n;r++)out[r]=0;
+	if(svmparam.kernel_type==LINEAR){
+		for(int x=0;x<nFeatures;x++){
+			double w=SVcoef[x];
+			double*cd=&batchD[(size_t)x*n];
+			for(int r=0;r<n;r++)out[r]+=cd[r]*w;
+		}
+	}else if(svmparam.kernel_type==POLY){
+		float*dot=(float*)batchT.ptr;
+		double*coef=svmmdl->sv_coef[0];
+		for(int l=0;l<svmmdl->l;l++){
+			float*svc=mSVcoef[l];
+			for(int r=0;r<n;r++)dot[r]=0;
+			for(int x=0;x<nFeatures;x++){
+				float w=svc[x];
+				float*cf=&batchF[(size_t)x*n];
+				for(int r=0;r<n;r++)dot[r]+=cf[r]*w;
+			}
+			for(int r=0;r<n;r++){
+				double kv=svmparam.gamma*dot[r]+svmparam.coef0;
+				if(svmparam.degree==2)out[r]+=kv*kv*coef[l];
+				else if(svmparam.degree==3)out[r]+=kv*kv*kv*coef[l];
+			}
+		}
+	}else{
+		double*qdist=batchT.ptr;
+		double*coef=svmmdl->sv_coef[0];
+		for(int l=0;l<svmmdl->l;l++){
+			svm_node*csv=svmmdl->SV[l];
+			for(int r=0;r<n;r++)qdist[r]=0;
+			for(int x=0;x<nFeatures;x++){
+				double w=csv[x].value;
+				double*cd=&batchD[(size_t)x*n];
+				for(int r=0;r<n;r++){
+					double tmp=cd[r]-w;
+					qdist[r]+=tmp*tmp;
+				}
+			}
+			for(int r=0;r<n;r++)out[r]+=exp(-svmparam.gamma*qdist[r])*coef[l];
+		}
+	}
+	for(int r=0;r<n;r++)out[r]-=rho;
+}
+
 void fastSVMClassifier::printInfo(char*header){
 	if(name.length() > 0){
 		cout << t_indent << header << " - " << name << "\n";
@@ -561,12 +2175,28 @@ void fastSVMClassifier::printInfo(char*header){
 		cout << t_indent << t_indent << "p: " << cfg->SVM_p << "\n";
 	}
 	cout << t_indent << t_indent << "# SV: " << svmmdl->l << "\n";
+	if(dualCDIter)cout << t_indent << t_indent << "Solver: Dual coordinate descent (" << dualCDIter << " passes)\n";
+	if(cascadeSets)cout << t_indent << t_indent << "Solver: Cascade (" << cascadeSets << " subsets, " << cascadePasses << " refinement passes)\n";
+	if(approxRank){
+		cout << t_indent << t_indent << "RBF kernel approximation: " << approxRank << " random Fourier features\n";
+		cout << t_indent << t_indent << t_indent << "Mean absolute error (training set): " << approxMeanError << "\n";
+		cout << t_indent << t_indent << t_indent << "Agreement with exact model (training set): " << (approxAgreement*100.0) << " %\n";
+	}
+	if(reducedTrials.size()){
+		cout << t_indent << t_indent << "Reduced support vector set: ";
+		if(reducedSize)cout << reducedSize << " vectors (" << (double(svmmdl->l)/reducedSize) << "x fewer kernel evaluations)\n";
+		else cout << "None within the accuracy loss\n";
+		for(auto&t:reducedTrials){
+			cout << t_indent << t_indent << t_indent << t.first << " vectors: " << (t.second*100.0) << " % agreement with full model (training set)\n";
+		}
+		if(reducedSize)cout << t_indent << t_indent << t_indent << "Mean absolute error (training set): " << reducedMeanError << "\n";
+	}
 	
 	if(svmparam.kernel_type == LINEAR){
 		
 		cout << t_indent << t_indent << "Model weights (linear SVM)\n";
 		double modelBias = 0.0;
-		for(int l=0;l<nFeatures;l++){
+		for(int l=0;l<nFeatures&&!sparse;l++){
 			double range = vMax[l] - vMin[l];
 			double s = 0;
 			if(range != 0.0) s = 2.0 / range;
@@ -577,13 +2207,14 @@ void fastSVMClassifier::printInfo(char*header){
 		for(int l=0;l<nFeatures;l++){
 			double range = vMax[l] - vMin[l];
 			double s = 0;
-			if(range != 0.0) s = 2.0 / range;
+			if(sparse) s = vScale[l];
+			else if(range != 0.0) s = 2.0 / range;
 			// Show coefficient
 			double weight = s * SVcoef[l];
 			cout << t_indent << t_indent << t_indent << "Feature weight - " << featureNames[l] << ": " << weight << "\n";
 		}
 		
-	}else if(svmparam.kernel_type == POLY && svmparam.degree == 2 && svmparam.coef0 == 0.0){
+	}else if(!sparse && svmparam.kernel_type == POLY && svmparam.degree == 2 && svmparam.coef0 == 0.0){
 		
 		cout << t_indent << t_indent << "Model weights (quadratic SVM)\n";
 		
@@ -687,10 +2318,24 @@ bool fastSVMClassifier::exportAnalysisData(FILE*f, char*title, char*indent){
 		fprintf(f, "%s - p: %.14f\n", indent, cfg->SVM_p);
 	}
 	fprintf(f, "%s - # SV: %d\n", indent, svmmdl->l);
+	if(dualCDIter)fprintf(f, "%s - Solver: Dual coordinate descent (%d passes)\n", indent, dualCDIter);
+	if(cascadeSets)fprintf(f, "%s - Solver: Cascade (%d subsets, %d refinement passes)\n", indent, cascadeSets, cascadePasses);
+	if(approxRank){
+		fprintf(f, "%s - RBF kernel approximation: %d random Fourier features\n", indent, approxRank);
+		fprintf(f, "%s - Mean absolute error (training set): %.14f\n", indent, approxMeanError);
+		fprintf(f, "%s - Agreement with exact model (training set): %.14f\n", indent, approxAgreement);
+	}
+	if(reducedTrials.size()){
+		fprintf(f, "%s - Reduced support vector set: %d vectors\n", indent, reducedSize);
+		for(auto&t:reducedTrials){
+			fprintf(f, "%s - Reduced set of %d vectors, agreement with full model (training set): %.14f\n", indent, t.first, t.second);
+		}
+		if(reducedSize)fprintf(f, "%s - Reduced set mean absolute error (training set): %.14f\n", indent, reducedMeanError);
+	}
 	if(svmparam.kernel_type == LINEAR){
 		fprintf(f, "%s - Model weights (linear SVM, scaled)\n", indent);
 		double modelBias = 0.0;
-		for(int l=0;l<nFeatures;l++){
+		for(int l=0;l<nFeatures&&!sparse;l++){
 			double range = vMax[l] - vMin[l];
 			double s = 0;
 			if(range != 0.0) s = 2.0 / range;
@@ -701,12 +2346,13 @@ bool fastSVMClassifier::exportAnalysisData(FILE*f, char*title, char*indent){
 		for(int l=0;l<nFeatures;l++){
 			double range = vMax[l] - vMin[l];
 			double s = 0;
-			if(range != 0.0) s = 2.0 / range;
+			if(sparse) s = vScale[l];
+			else if(range != 0.0) s = 2.0 / range;
 			// Show coefficient
 			double weight = s * SVcoef[l];
 			fprintf(f, "%s -  - Feature weight - %s: %.14f\n", indent, featureNames[l].c_str(), weight);
 		}
-	}else if(svmparam.kernel_type == POLY && svmparam.degree == 2 && svmparam.coef0 == 0.0){
+	}else if(!sparse && svmparam.kernel_type == POLY && svmparam.degree == 2 && svmparam.coef0 == 0.0){
 		fprintf(f, "%s - Model weights (quadratic SVM, scaled)\n", indent);
 		
 		double gamma = svmparam.gamma;
@@ -813,6 +2459,14 @@ MultiClassSVM::MultiClassSVM(int nf,int _svmt,std::string _name){
 	nFeatures=nf;
 	svmtype=_svmt;
 	name = _name;
+	batchCap=0;
+	compiledDegree=0;
+	compiledTerms=0;
+	sharedScaling=false;
+	poolSize=0;
+	poolStamp=0;
+	nReleasedExamples=0;
+	keepTrainingExamples=false;
 }
 
 MultiClassSVM*MultiClassSVM::create(int _svmtype,int nfeatures,std::string _name){
@@ -834,11 +2488,11 @@ bool MultiClassSVM::addTrain(double*v,int vl,seqClass*c,double cE){
 		cout << t_indent << vl << " != " << nFeatures << "\n";
 		return false;
 	}
-	baseClassifierSmp*t = baseClassifierSmp::create(v,vl,c);
-	if(!t)return 0;
-	t->clsE = cE;
-	trainingExamples.push_back(t);
-	return true;
+	if(!trainingExamples.ptr){
+		trainingExamples.ptr=trainingMatrix::create(nFeatures,trainingLayout_Rows,false);
+		if(!trainingExamples.ptr)return false;
+	}
+	return trainingExamples.ptr->add(v,c,cE);
 }
 
 bool MultiClassSVM::train(){
@@ -846,9 +2500,16 @@ bool MultiClassSVM::train(){
 		cmdError("Classifier already trained.");
 		return false;
 	}
+	trainingMatrix*tm=trainingExamples.ptr;
+	int ntrain=tm?tm->nrows:0;
+	autofree<double> buf((size_t)nFeatures+1);
+	if(!buf.ptr){
+		outOfMemory();
+		return false;
+	}
 	// Note classes.
-	for(baseClassifierSmp*t: trainingExamples.v){
-		seqClass*cls=t->cls;
+	for(int l=0;l<ntrain;l++){
+		seqClass*cls=tm->classes[l];
 		// Skip any classes already noted.
 		bool found=false;
 		for(int y=0;y<(int)classes.size();y++){
@@ -863,6 +2524,43 @@ bool MultiClassSVM::train(){
 		c.cls=cls;
 		classes.push_back(c);
 	}
+	// Share scaling between borders if the support vectors can be pooled,
+	// and either -SVM:pool is set, or the feature ranges of each border,
+	// over its two classes, are those over all classes anyway.
+	config*cfg=getConfiguration();
+	sharedScaling=cfg->SVM_ReduceMaxLoss<=0&&((cfg->kernel==kRBF&&!cfg->SVM_RBFApproxRank)
+		||(cfg->kernel==kCubic&&nFeatures>fastSVMCollapseMaxCubic));
+	std::vector<double> vMin(nFeatures),vMax(nFeatures);
+	if(sharedScaling){
+		int nc=(int)classes.size();
+		std::vector<double> cMin((size_t)nc*nFeatures),cMax((size_t)nc*nFeatures);
+		std::vector<bool> cSeen(nc,false);
+		for(int l=0;l<ntrain;l++){
+			double*v=tm->getVector(l,buf.ptr);
+			int c=0;
+			while(classes[c].cls!=tm->classes[l])c++;
+			double*mn=&cMin[(size_t)c*nFeatures],*mx=&cMax[(size_t)c*nFeatures];
+			for(int x=0;x<nFeatures;x++){
+				if(!l||v[x]>vMax[x])vMax[x]=v[x];
+				if(!l||v[x]<vMin[x])vMin[x]=v[x];
+				if(!cSeen[c]||v[x]>mx[x])mx[x]=v[x];
+				if(!cSeen[c]||v[x]<mn[x])mn[x]=v[x];
+			}
+			cSeen[c]=true;
+		}
+		for(int a=0;a<nc-1&&sharedScaling&&!cfg->SVM_SharedScaling;a++){
+			for(int b=a+1;b<nc&&sharedScaling;b++){
+				for(int x=0;x<nFeatures;x++){
+					double mn=std::min(cMin[(size_t)a*nFeatures+x],cMin[(size_t)b*nFeatures+x]);
+					double mx=std::max(cMax[(size_t)a*nFeatures+x],cMax[(size_t)b*nFeatures+x]);
+					if(mn!=vMin[x]||mx!=vMax[x]){
+						sharedScaling=false;
+						break;
+					}
+				}
+			}
+		}
+	}
 	// Note class pairs.
 	for(int x=0;x<(int)classes.size()-1;x++){
 		for(int y=x+1;y<(int)classes.size();y++){
@@ -879,42 +2577,187 @@ bool MultiClassSVM::train(){
 					cls->featureNames.push_back(std::string(featureNames[z]));
 				}
 			}
+			if(sharedScaling)cls->setScaling(vMin.data(),vMax.data());
 			classifiers.push_back(cls);
 			p.classifier=cls;
 			borders.push_back(p);
-			// Train.
-			for(baseClassifierSmp*t: trainingExamples.v){
-				if(t->cls!=p.clsP->cls
-				&&t->cls!=p.clsN->cls){
+			// Add training examples.
+			borderExamples.push_back(std::vector<int>());
+			for(int l=0;l<ntrain;l++){
+				seqClass*c=tm->classes[l];
+				if(c!=p.clsP->cls
+				&&c!=p.clsN->cls){
 					continue;
 				}
-				if(!cls->addTrainV(t->vec,t->vecl,t->cls,t->cls==p.clsP->cls?1.0:-1.0)){
+				if(!cls->addTrainV(tm->getVector(l,buf.ptr),nFeatures,c,c==p.clsP->cls?1.0:-1.0)){
 					return false;
 				}
+				borderExamples.back().push_back(l);
 			}
-			if(!cls->train())return false;
+		}
+	}
+	// Train the class border models concurrently.
+	std::vector<std::function<bool()>> tasks;
+	std::vector<size_t> costs;
+	for(auto&p:borders){
+		baseClassifier*cls=p.classifier;
+		tasks.push_back([cls]() -> bool { return cls->train(); });
+		costs.push_back(cls->getNTrainingExamples());
+	}
+	if(!runParallel(tasks,costs,getConfiguration()->nThreads))return false;
+	// Note how many borders of each class remain after each border.
+	int nc=(int)classes.size(),nb=(int)borders.size();
+	if(!bordersLeft.resize((size_t)nb*nc))return false;
+	for(int c=0;c<nc;c++){
+		int left=0;
+		for(int b=nb-1;b>=0;b--){
+			bordersLeft[b*nc+c]=left;
+			if(borders[b].clsP==&classes[c]||borders[b].clsN==&classes[c])left++;
 		}
 	}
 	trained=true;
+	if(!compile())return false;
+	if(!poolSupportVectors())return false;
+	// The borders have their own copies of the training examples.
+	std::vector<std::vector<int>>().swap(borderExamples);
+	if(!keepTrainingExamples)releaseTrainingExamples();
 	return true;
 }
 
-seqClass*MultiClassSVM::apply(double*vec,int vecl){
-	if(!trained){
-		cmdError("Tried to apply untrained classifier.");
-		return 0;
+bool MultiClassSVM::poolSupportVectors(){
+	poolSize=0;
+	if(!sharedScaling||compiledDegree)return true;
+	for(fastSVMClassifier*c:classifiers.v){
+		if(!c->isKernelExpansion())return true;
+	}
+	int n=nFeatures,nb=(int)borders.size();
+	size_t ncoef=0;
+	for(int b=0;b<nb;b++)ncoef+=classifiers[b]->getModel()->l;
+	if(!poolStart.resize(nb+1)||!poolIndex.resize(ncoef)||!poolCoef.resize(ncoef))return false;
+	// Support vectors from the same training example are identical, as
+	// the borders share scaling.
+	std::vector<int> pooled(trainingExamples.ptr->nrows,-1);
+	std::vector<svm_node*> sv;
+	size_t k=0;
+	for(int b=0;b<nb;b++){
+		poolStart[b]=(int)k;
+		svm_model*mdl=classifiers[b]->getModel();
+		for(int l=0;l<mdl->l;l++,k++){
+			int e=borderExamples[b][mdl->sv_indices[l]-1];
+			if(pooled[e]<0){
+				pooled[e]=(int)sv.size();
+				sv.push_back(mdl->SV[l]);
+			}
+			poolIndex[k]=pooled[e];
+			poolCoef[k]=mdl->sv_coef[0][l];
+		}
 	}
-	if(vecl!=nFeatures){
-		cmdWarning("Vector to classify is of incorrect size.");
-		return 0;
+	poolStart[nb]=(int)k;
+	int ns=(int)sv.size();
+	if(!poolSV.resize((size_t)ns*n)||!poolK.resize(ns)||!poolKStamp.resize(ns)
+	||!poolVec.resize(n+1)||!poolVotes.resize(classes.size()))return false;
+	for(int s=0;s<ns;s++){
+		memcpy(&poolSV[(size_t)s*n],sv[s],sizeof(svm_node)*n);
+	}
+	poolKStamp.fill(ns,0);
+	poolStamp=0;
+	for(int x=0;x<n;x++)poolVec[x].index=x;
+	poolVec[n].index=-1;
+	poolSize=ns;
+	return true;
+}
+
+seqClass*MultiClassSVM::applyPooled(double*vec){
+	int n=nFeatures,nb=(int)borders.size(),nc=(int)classes.size();
+	fastSVMClassifier*kc=classifiers[0];
+	for(int x=0;x<n;x++)poolVec[x].value=vec[x];
+	kc->scaleVector(poolVec.ptr);
+	if(!++poolStamp){
+		poolKStamp.fill(poolSize,0);
+		poolStamp=1;
+	}
+	for(int c=0;c<nc;c++)poolVotes[c]=0;
+	for(int b=0;b<nb;b++){
+		auto&p=borders[b];
+		double r=0;
+		for(int k=poolStart[b];k<poolStart[b+1];k++){
+			int s=poolIndex[k];
+			if(poolKStamp[s]!=poolStamp){
+				poolK[s]=kc->kernelScaled(poolVec.ptr,&poolSV[(size_t)s*n]);
+				poolKStamp[s]=poolStamp;
+			}
+			r+=poolCoef[k]*poolK[s];
+		}
+		if(r-classifiers[b]->getModel()->rho[0]>p.classifier->threshold)poolVotes[(int)(p.clsP-&classes[0])]++;
+		else poolVotes[(int)(p.clsN-&classes[0])]++;
+		if(b<nb-1&&isVoteDecided(poolVotes.ptr,&bordersLeft[b*nc]))break;
+	}
+	// Find the (first) class with the most votes.
+	int best=0;
+	for(int c=1;c<nc;c++){
+		if(poolVotes[c]>poolVotes[best])best=c;
+	}
+	return classes[best].cls;
+}
+
+bool MultiClassSVM::compile(){
+	compiledDegree=0;
+	int nb=(int)borders.size();
+	if(!nb)return true;
+	int n=nFeatures;
+	std::vector<int> degree(nb);
+	std::vector<double> b(nb),w((size_t)nb*n);
+	std::vector<double*> P(nb);
+	int maxDegree=1;
+	for(int x=0;x<nb;x++){
+		if(!classifiers[x]->getPolynomial(degree[x],b[x],&w[(size_t)x*n],P[x]))return true;
+		maxDegree=max(maxDegree,degree[x]);
+	}
+	int nterms=n;
+	if(maxDegree==2)nterms+=n*(n+1)/2;
+	if(!compiledM.resize((size_t)nterms*nb)||!compiledB.resize(nb)
+	||!compiledZ.resize(nterms)||!compiledV.resize(nb)){
+		return false;
+	}
+	compiledM.fill((size_t)nterms*nb,0);
+	for(int x=0;x<nb;x++){
+		compiledB[x]=b[x];
+		for(int i=0;i<n;i++)compiledM[i*nb+x]=w[(size_t)x*n+i];
+		if(degree[x]==2){
+			for(int t=0;t<n*(n+1)/2;t++)compiledM[(n+t)*nb+x]=P[x][t];
+		}
+	}
+	compiledTerms=nterms;
+	compiledDegree=maxDegree;
+	return true;
+}
+
+seqClass*MultiClassSVM::applyCompiled(double*vec){
+	int n=nFeatures,nb=(int)borders.size();
+	double*z=compiledZ.ptr;
+	for(int i=0;i<n;i++)z[i]=vec[i];
+	if(compiledDegree==2){
+		double*zq=z+n;
+		for(int i=0;i<n;i++){
+			double xi=vec[i];
+			for(int j=i;j<n;j++)*zq++=xi*vec[j];
+		}
+	}
+	double*v=compiledV.ptr;
+	for(int x=0;x<nb;x++)v[x]=compiledB[x];
+	double*m=compiledM.ptr;
+	for(int t=0;t<compiledTerms;t++,m+=nb){
+		double zt=z[t];
+		if(zt==0)continue;
+		for(int x=0;x<nb;x++)v[x]+=m[x]*zt;
 	}
 	// Have classifiers vote for the correct class.
 	for(auto&c:classes){
 		c.votes=0;
 	}
-	for(auto&p:borders){
-		double v=p.classifier->apply(vec,vecl);
-		if(v>0)p.clsP->votes++;
+	for(int x=0;x<nb;x++){
+		MultiClassClassPair&p=borders[x];
+		if(v[x]>0)p.clsP->votes++;
 		else p.clsN->votes++;
 	}
 	// Find the (first) class with the most votes.
@@ -929,15 +2772,141 @@ seqClass*MultiClassSVM::apply(double*vec,int vecl){
 	return r;
 }
 
+int MultiClassSVM::getNTrainingExamples(){
+	return trainingExamples.ptr?trainingExamples.ptr->nrows:nReleasedExamples;
+}
+
+double*MultiClassSVM::getTrainingVector(int i,double*buf){
+	return trainingExamples.ptr->getVector(i,buf);
+}
+
+void MultiClassSVM::releaseTrainingExamples(){
+	if(!trainingExamples.ptr)return;
+	nReleasedExamples=trainingExamples.ptr->nrows;
+	delete trainingExamples.disown();
+}
+
+seqClass*MultiClassSVM::apply(double*vec,int vecl){
+	if(!trained){
+		cmdError("Tried to apply untrained classifier.");
+		return 0;
+	}
+	if(vecl!=nFeatures){
+		cmdWarning("Vector to classify is of incorrect size.");
+		return 0;
+	}
+	if(compiledDegree)return applyCompiled(vec);
+	if(poolSize)return applyPooled(vec);
+	seqClass*r=0;
+	if(!applyBatch(vec,1,vecl,&r))return 0;
+	return r;
+}
+
+bool MultiClassSVM::isVoteDecided(int*votes,int*left){
+	int nc=(int)classes.size();
+	// The (first) class with the most votes wins ties with later classes.
+	int best=0;
+	for(int c=1;c<nc;c++){
+		if(votes[c]>votes[best])best=c;
+	}
+	for(int c=0;c<nc;c++){
+		if(c==best)continue;
+		int v=votes[c]+left[c];
+		if(v>votes[best]||(c<best&&v==votes[best]))return false;
+	}
+	return true;
+}
+
+bool MultiClassSVM::applyBatch(double*m,int n,int vecl,seqClass**out){
+	if(!trained){
+		cmdError("Tried to apply untrained classifier.");
+		return false;
+	}
+	if(vecl!=nFeatures){
+		cmdWarning("Vectors to classify are of incorrect size.");
+		return false;
+	}
+	if(compiledDegree){
+		for(int r=0;r<n;r++)out[r]=applyCompiled(&m[(size_t)r*vecl]);
+		return true;
+	}
+	if(poolSize){
+		for(int r=0;r<n;r++)out[r]=applyPooled(&m[(size_t)r*vecl]);
+		return true;
+	}
+	int nc=(int)classes.size();
+	if(n>batchCap){
+		if(!batchScores.resize(n)||!batchVotes.resize((size_t)n*nc)
+		||!batchActive.resize(n)||!batchRows.resize((size_t)n*vecl)){
+			batchCap=0;
+			return false;
+		}
+		batchCap=n;
+	}
+	batchVotes.fill((size_t)n*nc,0);
+	int nActive=n;
+	for(int r=0;r<n;r++)batchActive[r]=r;
+	// Have classifiers vote for the correct class, for all undecided rows at once.
+	// Few rows are classified one by one.
+	int nb=(int)borders.size();
+	for(int b=0;b<nb&&nActive;b++){
+		auto&p=borders[b];
+		int iP=(int)(p.clsP-&classes[0]),iN=(int)(p.clsN-&classes[0]);
+		if(nActive<fastSVMBatchMinRows){
+			for(int i=0;i<nActive;i++){
+				int r=batchActive[i];
+				if(p.classifier->apply(&m[(size_t)r*vecl],vecl)>0)batchVotes[r*nc+iP]++;
+				else batchVotes[r*nc+iN]++;
+			}
+		}else{
+			double*rows=m;
+			if(nActive<n){
+				for(int i=0;i<nActive;i++){
+					memcpy(&batchRows[(size_t)i*vecl],&m[(size_t)batchActive[i]*vecl],sizeof(double)*vecl);
+				}
+				rows=batchRows.ptr;
+			}
+			if(!p.classifier->applyBatch(rows,nActive,vecl,batchScores.ptr))return false;
+			for(int i=0;i<nActive;i++){
+				int r=batchActive[i];
+				if(batchScores[i]>0)batchVotes[r*nc+iP]++;
+				else batchVotes[r*nc+iN]++;
+			}
+		}
+		// Drop rows whose winning class is certain.
+		if(b==nb-1)break;
+		int k=0;
+		for(int i=0;i<nActive;i++){
+			int r=batchActive[i];
+			if(!isVoteDecided(&batchVotes[r*nc],&bordersLeft[b*nc]))batchActive[k++]=r;
+		}
+		nActive=k;
+	}
+	// Find the (first) class with the most votes.
+	for(int r=0;r<n;r++){
+		int*votes=&batchVotes[r*nc];
+		int maxVotes=-1;
+		out[r]=0;
+		for(int c=0;c<nc;c++){
+			if(votes[c]>maxVotes){
+				maxVotes=votes[c];
+				out[r]=classes[c].cls;
+			}
+		}
+	}
+	return true;
+}
+
 void MultiClassSVM::printInfo(char*header){
 	if(name.length() > 0){
 		cout << t_indent << header << " - " << name << "\n";
 	}else{
 		cout << t_indent << header << "\n";
 	}
-	cout << t_indent << t_indent << "Training examples: " << (trainingExamples.v.size()) << "\n";
+	cout << t_indent << t_indent << "Training examples: " << getNTrainingExamples() << "\n";
 	cout << t_indent << t_indent << "Classes: " << classes.size() << "\n";
 	cout << t_indent << t_indent << "Class borders: " << borders.size() << "\n";
+	if(poolSize)cout << t_indent << t_indent << "Pooled support vectors: " << poolSize << " (of " << poolStart[borders.size()] << " over all borders)\n";
 	for(auto&p:borders){
 		p.classifier->printInfo((char*)"Boundary");
 	}
@@ -949,9 +2918,10 @@ bool MultiClassSVM::exportAnalysisData(FILE*f, char*title, char*indent){
 	}else{
 		fprintf(f,"%s%s\n",indent,title);
 	}
-	fprintf(f,"%s - Training examples: %d\n",indent,(int)trainingExamples.v.size());
+	fprintf(f,"%s - Training examples: %d\n",indent,getNTrainingExamples());
 	fprintf(f,"%s - Classes: %d\n",indent,(int)classes.size());
 	fprintf(f,"%s - Class borders: %d\n",indent,(int)borders.size());
+	if(poolSize)fprintf(f,"%s - Pooled support vectors: %d (of %d over all borders)\n",indent,poolSize,poolStart[borders.size()]);
 	for(auto&p:borders){
 		if(!p.classifier->exportAnalysisData(f, (char*)"Boundary", (char*)(std::string(indent)+" - ").c_str() ))
 			return false;
@@ -964,6 +2934,7 @@ bool MultiClassSVM::exportAnalysisData(FILE*f, char*title, char*indent){
 //	Trains RF with Ranger.
 
 RFClassifier::RFClassifier(int nf):baseClassifier(nf){
+	trainingExampleLayout=trainingLayout_Columns;
 }
 
 RFClassifier*RFClassifier::create(int nf, std::string name){
@@ -985,7 +2956,11 @@ bool RFClassifier::do_train(){
 	// Fill in data values
 	std::unique_ptr<RangerData> data{};
 	data = ranger::make_unique<RangerData>(); //new ranger::DataDouble();
-	data->setDataT(nFeatures, trainingExamples.v);
+	if(!trainingExamples.ptr){
+		cmdError("No training examples.");
+		return false;
+	}
+	data->setColumns(trainingExamples.ptr);
 	
 	// Train model
 	std::vector<std::string> catvars;
@@ -998,7 +2973,7 @@ bool RFClassifier::do_train(){
 		std::string(""), //std::string output_prefix,
 		getConfiguration()->RF_nTrees, //uint num_trees,
 		(ranger::uint)0, //uint seed,
-		(ranger::uint)getConfiguration()->nThreads, //uint num_threads,
+		(ranger::uint)(isParallelWorker()?1:getConfiguration()->nThreads), //uint num_threads,
 		//ranger::ImportanceMode::IMP_NONE, //ImportanceMode importance_mode,
 		ranger::ImportanceMode::IMP_PERM_CASEWISE, //ImportanceMode importance_mode,
 		(ranger::uint)0, //uint min_node_size,
@@ -1022,15 +2997,225 @@ bool RFClassifier::do_train(){
 	);
 	rf.ptr->train();
 	
-	return true;
+	flat.ptr=RFFlatForest::create(rf.ptr,nFeatures);
+	return flat.ptr!=0;
+}
+
+void RFClassifier::finalize(){
+	delete rf.disown();
+	baseClassifier::finalize();
 }
 
 double RFClassifier::do_apply(double*vec){
-	return rf.ptr->predictVec(vec);
+	return flat.ptr->apply(vec);
+}
+
+void RFClassifier::do_applyBatch(double*m,int n,double*out){
+	if(!flat.ptr->applyBatch(m,n,out)){
+		for(int r=0;r<n;r++)out[r]=0;
+	}
 }
 
 void RFClassifier::printInfo(char*header){
 	cout << t_indent << header << "\n";
+	if(flat.ptr){
+		cout << t_indent << t_indent << "Trees: " << flat.ptr->getNTrees() << " (" << flat.ptr->getNNodes() << " nodes)\n";
+		if(flat.ptr->isQuick())cout << t_indent << t_indent << "Scored with QuickScorer\n";
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+// Flattened random forest
+
+RFFlatForest::RFFlatForest(){
+	nTrees=0;
+	nFeatures=0;
+	quick=false;
+	batchCap=0;
+}
+
+RFFlatForest*RFFlatForest::create(RangerRandomForest*rf,int nf){
+	autodelete<RFFlatForest> r(new RFFlatForest());
+	if(!r.ptr){
+		outOfMemory();
+		return 0;
+	}
+	std::vector<std::vector<std::vector<size_t>>> child=rf->getChildNodeIDs();
+	std::vector<std::vector<size_t>> var=rf->getSplitVarIDs();
+	std::vector<std::vector<double>> split=rf->getSplitValues();
+	std::vector<std::vector<std::vector<double>>> counts=rf->getTerminalClassCounts();
+	const std::vector<double>&cv=rf->getClassValues();
+	int iPos=-1,iNeg=-1;
+	for(int c=0;c<(int)cv.size();c++){
+		if(cv[c]==1.0)iPos=c;
+		else if(cv[c]==-1.0)iNeg=c;
+	}
+	int nt=(int)child.size();
+	r.ptr->nTrees=nt;
+	r.ptr->nFeatures=nf;
+	if(!r.ptr->treeRoot.resize(nt+1))return 0;
+	int nn=0;
+	for(int t=0;t<nt;t++){
+		r.ptr->treeRoot[t]=nn;
+		nn+=(int)split[t].size();
+	}
+	r.ptr->treeRoot[nt]=nn;
+	if(!r.ptr->nodeFeature.resize(nn)||!r.ptr->nodeSplit.resize(nn)
+	||!r.ptr->nodeLeft.resize(nn)||!r.ptr->nodeRight.resize(nn)
+	||!r.ptr->nodePos.resize(nn)||!r.ptr->nodeNeg.resize(nn))return 0;
+	for(int t=0;t<nt;t++){
+		int base=r.ptr->treeRoot[t];
+		for(int i=0;i<(int)split[t].size();i++){
+			int o=base+i;
+			size_t cl=child[t][0][i],cr=child[t][1][i];
+			r.ptr->nodePos[o]=r.ptr->nodeNeg[o]=0;
+			if(!cl&&!cr){
+				r.ptr->nodeFeature[o]=-1;
+				r.ptr->nodeSplit[o]=0;
+				r.ptr->nodeLeft[o]=r.ptr->nodeRight[o]=o;
+				std::vector<double>&cc=counts[t][i];
+				if(iPos>=0&&iPos<(int)cc.size())r.ptr->nodePos[o]=cc[iPos];
+				if(iNeg>=0&&iNeg<(int)cc.size())r.ptr->nodeNeg[o]=cc[iNeg];
+				continue;
+			}
+			r.ptr->nodeFeature[o]=(int)var[t][i];
+			r.ptr->nodeSplit[o]=split[t][i];
+			r.ptr->nodeLeft[o]=base+(int)cl;
+			r.ptr->nodeRight[o]=base+(int)cr;
+		}
+	}
+	if(!r.ptr->compileQuick())return 0;
+	return r.disown();
+}
+
+bool RFFlatForest::compileQuick(){
+	quick=false;
+	// Number the leaves of each tree from left to right.
+	std::vector<int> leafIndex(treeRoot[nTrees],-1);
+	std::vector<uint64_t> leftLeaves(treeRoot[nTrees],0);
+	if(!quickLeafStart.resize(nTrees+1))return false;
+	int nLeaves=0,nInternal=0;
+	for(int t=0;t<nTrees;t++){
+		quickLeafStart[t]=nLeaves;
+		int nl=0;
+		// Depth-first, left first
+		std::vector<int> stack(1,treeRoot[t]);
+		while(stack.size()){
+			int o=stack.back();
+			stack.pop_back();
+			if(nodeFeature[o]<0){
+				if(nl==RFFlatForestQuickMaxLeaves)return true;
+				leafIndex[o]=nl++;
+				continue;
+			}
+			nInternal++;
+			stack.push_back(nodeRight[o]);
+			stack.push_back(nodeLeft[o]);
+		}
+		nLeaves+=nl;
+	}
+	quickLeafStart[nTrees]=nLeaves;
+	if(!quickPos.resize(nLeaves)||!quickNeg.resize(nLeaves)||!quickBits.resize(nTrees)
+	||!quickFeatureStart.resize(nFeatures+1)||!quickSplit.resize(nInternal)
+	||!quickTree.resize(nInternal)||!quickMask.resize(nInternal))return false;
+	// Leaf bits of left subtrees. Children follow their parents in Ranger
+	// trees, so a reverse pass has them ready.
+	struct quickNode{
+		int feature,tree;
+		double split;
+		uint64_t mask;
+	};
+	std::vector<quickNode> nodes;
+	std::vector<uint64_t> subtree(treeRoot[nTrees],0);
+	for(int t=0;t<nTrees;t++){
+		for(int o=treeRoot[t+1]-1;o>=treeRoot[t];o--){
+			if(nodeFeature[o]<0){
+				subtree[o]=1ULL<<leafIndex[o];
+				quickPos[quickLeafStart[t]+leafIndex[o]]=nodePos[o];
+				quickNeg[quickLeafStart[t]+leafIndex[o]]=nodeNeg[o];
+				continue;
+			}
+			if(nodeLeft[o]<=o||nodeRight[o]<=o)return true;
+			subtree[o]=subtree[nodeLeft[o]]|subtree[nodeRight[o]];
+			quickNode q={nodeFeature[o],t,nodeSplit[o],~subtree[nodeLeft[o]]};
+			nodes.push_back(q);
+		}
+	}
+	std::stable_sort(nodes.begin(),nodes.end(),[](const quickNode&a,const quickNode&b){
+		if(a.feature!=b.feature)return a.feature<b.feature;
+		return a.split<b.split;
+	});
+	int k=0;
+	for(int f=0;f<=nFeatures;f++){
+		while(k<(int)nodes.size()&&nodes[k].feature<f)k++;
+		quickFeatureStart[f]=k;
+	}
+	for(int i=0;i<(int)nodes.size();i++){
+		quickSplit[i]=nodes[i].split;
+		quickTree[i]=nodes[i].tree;
+		quickMask[i]=nodes[i].mask;
+	}
+	quick=true;
+	return true;
+}
+
+double RFFlatForest::applyQuick(double*vec){
+	for(int t=0;t<nTrees;t++)quickBits[t]=~0ULL;
+	for(int f=0;f<nFeatures;f++){
+		double v=vec[f];
+		for(int k=quickFeatureStart[f];k<quickFeatureStart[f+1]&&quickSplit[k]<v;k++){
+			quickBits[quickTree[k]]&=quickMask[k];
+		}
+	}
+	double pos=0,neg=0;
+	for(int t=0;t<nTrees;t++){
+		int l=quickLeafStart[t]+__builtin_ctzll(quickBits[t]);
+		pos+=quickPos[l];
+		neg+=quickNeg[l];
+	}
+	return pos/nTrees-neg/nTrees;
+}
+
+double RFFlatForest::apply(double*vec){
+	if(quick)return applyQuick(vec);
+	double pos=0,neg=0;
+	for(int t=0;t<nTrees;t++){
+		int o=treeRoot[t];
+		while(nodeFeature[o]>=0){
+			o=vec[nodeFeature[o]]<=nodeSplit[o]?nodeLeft[o]:nodeRight[o];
+		}
+		pos+=nodePos[o];
+		neg+=nodeNeg[o];
+	}
+	return pos/nTrees-neg/nTrees;
+}
+
+bool RFFlatForest::applyBatch(double*m,int n,double*out){
+	if(quick){
+		for(int r=0;r<n;r++)out[r]=applyQuick(&m[(size_t)r*nFeatures]);
+		return true;
+	}
+	if(n>batchCap){
+		if(!batchPos.resize(n)||!batchNeg.resize(n)){
+			batchCap=0;
+			return false;
+		}
+		batchCap=n;
+	}
+	for(int r=0;r<n;r++)batchPos[r]=batchNeg[r]=0;
+	for(int t=0;t<nTrees;t++){
+		double*v=m;
+		for(int r=0;r<n;r++,v+=nFeatures){
+			int o=treeRoot[t];
+			while(nodeFeature[o]>=0){
+				o=v[nodeFeature[o]]<=nodeSplit[o]?nodeLeft[o]:nodeRight[o];
+			}
+			batchPos[r]+=nodePos[o];
+			batchNeg[r]+=nodeNeg[o];
+		}
+	}
+	for(int r=0;r<n;r++)out[r]=batchPos[r]/nTrees-batchNeg[r]/nTrees;
+	return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////
@@ -1056,15 +3241,15 @@ LDAClassifier*LDAClassifier::create(int nf, std::string name){
 
 bool LDAClassifier::do_train(){
 	shogun::init_shogun_with_defaults();
-	int ntrain = trainingExamples.v.size();
+	int ntrain = getNTrainingExamples();
 	shogun::SGVector<double> lvec(ntrain);
 	shogun::SGMatrix<double> fmat(nFeatures, ntrain);
-	int row = 0;
-	for(baseClassifierSmp*t: trainingExamples.v){
+	std::vector<double> buf(nFeatures);
+	for(int row=0; row<ntrain; row++){
+		double*v = trainingExamples.ptr->getVector(row, buf.data());
 		for(int i=0; i<nFeatures; i++)
-			fmat(i, row) = t->vec[i];
-		lvec[row] = t->cls->flag ? 1 : -1;
-		row++;
+			fmat(i, row) = v[i];
+		lvec[row] = trainingExamples.ptr->classes[row]->flag ? 1 : -1;
 	}
 	shogun::CBinaryLabels*lbl = new shogun::CBinaryLabels(lvec);
 	shogun::CDenseFeatures<double>*fv = new shogun::CDenseFeatures<double>(fmat);
@@ -1110,15 +3295,15 @@ PerceptronClassifier*PerceptronClassifier::create(int nf, std::string name){
 
 bool PerceptronClassifier::do_train(){
 	shogun::init_shogun_with_defaults();
-	int ntrain = trainingExamples.v.size();
+	int ntrain = getNTrainingExamples();
 	shogun::SGVector<double> lvec(ntrain);
 	shogun::SGMatrix<double> fmat(nFeatures, ntrain);
-	int row = 0;
-	for(baseClassifierSmp*t: trainingExamples.v){
+	std::vector<double> buf(nFeatures);
+	for(int row=0; row<ntrain; row++){
+		double*v = trainingExamples.ptr->getVector(row, buf.data());
 		for(int i=0; i<nFeatures; i++)
-			fmat(i, row) = t->vec[i];
-		lvec[row] = t->cls->flag ? 1 : -1;
-		row++;
+			fmat(i, row) = v[i];
+		lvec[row] = trainingExamples.ptr->classes[row]->flag ? 1 : -1;
 	}
 	shogun::CBinaryLabels*lbl = new shogun::CBinaryLabels(lvec);
 	shogun::CDenseFeatures<double>*fv = new shogun::CDenseFeatures<double>(fmat);
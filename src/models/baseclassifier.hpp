@@ -11,34 +11,243 @@
 // Base classifiers
 //	These classifiers only classify vectors of values.
 
-class baseClassifierSmp{
+/*
+trainingLayout
+	How a trainingMatrix stores dense training examples.
+*/
+enum trainingLayout{
+	trainingLayout_Rows,		// Rows of feature values
+	trainingLayout_Nodes,		// Rows of LibSVM nodes, for training without conversion
+	trainingLayout_Columns,		// One column-major matrix
+};
+
+/*
+trainingMatrixChunkMin, trainingMatrixChunkMax
+	Sizes in bytes of the first and the largest chunks of a trainingMatrix.
+	Chunk sizes double from the first to the largest.
+*/
+#define trainingMatrixChunkMin 16384
+#define trainingMatrixChunkMax 16777216
+
+/*
+trainingMatrix
+	Training examples, with parallel arrays of classes and class values.
+	Rows are stored back to back in large chunks, rather than allocated
+	one by one. Dense rows are stored according to the layout: as feature
+	values, optionally in single precision, or as LibSVM nodes with all
+	features. Sparse rows are stored as LibSVM nodes, terminated by index
+	-1, unless the layout is trainingLayout_Columns, in which case they
+	are expanded. For the column layout, value c of example r is at
+	c*cap+r, and the capacity is doubled when full.
+	Rows of double values can also be viewed in a feature matrix file,
+	rather than copied. See addView.
+*/
+class featureMatrix;
+
+class trainingMatrix{
+private:
+	std::vector<void*> chunks;		// Row chunks
+	featureMatrix*source;			// Feature matrix file rows are viewed in, or 0. Owned.
+	size_t chunkSize,chunkUsed;		// Size and used bytes of the last chunk
+	std::vector<void*> rows;		// Row data, for row layouts
+	// Private constructor
+	trainingMatrix(int nc,trainingLayout l,bool s);
+	/*
+	allocRow
+		Allocates n bytes for a row in the last chunk, or in a new chunk.
+	*/
+	void*allocRow(size_t n);
 public:
-	autofree<double> vec;	// Training vector.
-	int vecl;				// Vector length.
-	seqClass*cls;			// Class.
-	double clsE;			// Double value class, such as for regression.
-	baseClassifierSmp(double*v,seqClass*c,double e);
-	~baseClassifierSmp(){  }
-	static baseClassifierSmp*create(double*v,int vl,seqClass*c);
+	trainingLayout layout;
+	bool single;					// Dense values are stored as float
+	bool sparse;					// Rows are sparse
+	int nrows,ncols,cap;
+	autofree<double> x;				// Column layout values
+	autofree<float> xf;				// Column layout values, in single precision
+	std::vector<seqClass*> classes;	// Classes of the examples
+	std::vector<double> values;		// Class values of the examples
+	~trainingMatrix();
+	/*
+	create
+		Call to construct. single is ignored for trainingLayout_Nodes.
+	*/
+	static trainingMatrix*create(int nc,trainingLayout l,bool s);
+	bool add(double*v,seqClass*c,double e);
+	/*
+	addSparse
+		Adds nnz non-zero values with 0-based indices, in increasing
+		index order. Dense and sparse examples can not be mixed.
+	*/
+	bool addSparse(svm_node*v,int nnz,seqClass*c,double e);
+	/*
+	addView
+		Adds the rows of a feature matrix file, viewed in place, and takes
+		ownership of fm. Rows are read-only. Returns false, without adding
+		any rows, unless rows are stored as double values in the
+		trainingLayout_Rows layout, and no other file is viewed.
+	*/
+	bool addView(featureMatrix*fm);
+	/*
+	getVector
+		Gets the dense vector of example r. Stored in buf, which must have
+		room for ncols values, unless stored as double values.
+	*/
+	double*getVector(int r,double*buf);
+	/*
+	getNodes
+		Gets the LibSVM nodes of a sparse example, or of a dense example
+		in the trainingLayout_Nodes layout.
+	*/
+	inline svm_node*getNodes(int r){ return (svm_node*)rows[r]; }
+	inline double getColumnValue(size_t r,size_t c){ return single?(double)xf.ptr[c*cap+r]:x.ptr[c*cap+r]; }
 };
 
 class baseClassifier{
 private:
+	int nReleasedExamples;			// Number of training examples released by finalize
+	bool initTrainingExamples();
 public:
-	deletevector<baseClassifierSmp> trainingExamples;
+	autodelete<trainingMatrix> trainingExamples;	// Created on the first training example
+	trainingLayout trainingExampleLayout;			// Layout of trainingExamples, set by the classifier
 	int nFeatures;
 	double threshold;
 	bool trained;
+	bool keepTrainingExamples;		// If set, finalize keeps the training examples until releaseTrainingExamples
 	baseClassifier(int nf);
 	virtual ~baseClassifier(){  }
-	baseClassifierSmp*addTrain(double*v,int vl,seqClass*c);
-	baseClassifierSmp*addTrainV(double*v,int vl,seqClass*c,double val);
+	bool addTrain(double*v,int vl,seqClass*c);
+	bool addTrainV(double*v,int vl,seqClass*c,double val);
+	/*
+	addTrainSparse
+		Adds a sparse training example. See trainingMatrix::addSparse.
+	*/
+	bool addTrainSparse(svm_node*v,int nnz,int vl,seqClass*c);
+	/*
+	addTrainMatrix
+		Adds the rows of a feature matrix file as dense training examples,
+		and takes ownership of fm. Rows are viewed in the file when the
+		training example layout allows it, and copied otherwise.
+	*/
+	bool addTrainMatrix(featureMatrix*fm);
+	int getNTrainingExamples();
+	seqClass*getTrainingClass(int i);
+	/*
+	getTrainingVector
+		Gets the dense vector of training example i. Stored in buf, which
+		must have room for nFeatures values, if not stored densely.
+	*/
+	double*getTrainingVector(int i,double*buf);
 	double apply(double*v,int vl);
+	/*
+	applySparse
+		Applies the classifier to a sparse vector of length vl, with
+		non-zero values terminated by index -1.
+	*/
+	double applySparse(svm_node*v,int vl);
+	/*
+	applyBatch
+		Applies the classifier to the n rows of the row-major matrix m,
+		with vl values per row, and stores the scores in out.
+	*/
+	bool applyBatch(double*m,int n,int vl,double*out);
 	bool train();
 	virtual bool exportAnalysisData(FILE*f, char*title, char*indent);
 	virtual bool do_train() = 0;
+	/*
+	finalize
+		Called by train after do_train. Releases the training examples,
+		keeping their number. Classifiers also release any other training
+		data, keeping only what is needed for application and output.
+	*/
+	virtual void finalize();
+	/*
+	releaseTrainingExamples
+		Releases the training examples, keeping their number.
+	*/
+	void releaseTrainingExamples();
 	virtual double do_apply(double*v) = 0;
+	/*
+	do_applyBatch
+		Batched do_apply. By default, applies row by row.
+	*/
+	virtual void do_applyBatch(double*m,int n,double*out);
+	/*
+	do_applySparse
+		Sparse do_apply. By default, expands the vector and calls do_apply.
+	*/
+	virtual double do_applySparse(svm_node*v);
 	virtual void printInfo(char*header) = 0;
+protected:
+	autofree<double> denseVec;	// Expanded vector for the default do_applySparse
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////
+// Feature matrix store
+//	Binary files holding training feature vectors, so that training can be
+//	repeated without re-extracting features. The file consists of a header,
+//	the feature names and class names (null-terminated strings), a class
+//	table, row class indices and the row-major feature matrix. Sections
+//	are 8-byte aligned, and files are memory mapped when loaded, so that
+//	classifiers training on dense rows can use the matrix in place.
+
+#define featureMatrixMagic "MOCCAFM1"
+
+typedef struct{
+	char magic[8];			// featureMatrixMagic
+	uint64_t hash;			// Feature set hash
+	int32_t nrows,ncols;	// Matrix dimensions
+	int32_t nclasses;		// Number of classes
+	int32_t pad;
+	int64_t oNames;			// Offset of feature names
+	int64_t oClasses;		// Offset of class table (featureMatrixClass)
+	int64_t oClassNames;	// Offset of class names
+	int64_t oLabels;		// Offset of row class indices (int32_t)
+	int64_t oData;			// Offset of the feature matrix (double)
+	int64_t size;			// File size
+}featureMatrixHeader;
+
+typedef struct{
+	double cls;				// Class identifier value
+	int32_t flag;			// Class flag
+	int32_t pad;
+}featureMatrixClass;
+
+class featureMatrix{
+private:
+	char*mem;				// File contents
+	size_t memSize;			// Size of file contents
+	bool mapped;			// True if mem is memory mapped
+	// Private constructor
+	featureMatrix();
+public:
+	featureMatrixHeader*header;
+	std::vector<std::string> names;		// Feature names
+	std::vector<seqClass*> classes;		// Row classes, by class index
+	int32_t*labels;						// Row class indices
+	double*data;						// Row-major feature matrix
+	~featureMatrix();
+	/*
+	load
+		Loads a feature matrix file. Classes are matched with registered
+		classes by identifier value.
+	*/
+	static featureMatrix*load(std::string path);
+	/*
+	save
+		Saves training examples as a feature matrix file. Sparse examples
+		are stored expanded.
+	*/
+	static bool save(std::string path,uint64_t hash,std::vector<std::string>&names,baseClassifier*bc);
+	/*
+	getHash
+		Returns a hash of feature names and a list of settings values the
+		features depend on.
+	*/
+	static uint64_t getHash(std::vector<std::string>&names,std::vector<long long>&settings);
+	inline int getNRows(){ return header->nrows; }
+	inline int getNCols(){ return header->ncols; }
+	inline double*getRow(int i){ return data+(size_t)i*header->ncols; }
 };
 
 
@@ -58,6 +267,8 @@ public:
 	double getWeight(int i);
 	bool do_train();
 	double do_apply(double*vec);
+	void do_applyBatch(double*m,int n,double*out);
+	double do_applySparse(svm_node*v);
 	void printInfo(char*header);
 	bool exportAnalysisData(FILE*f, char*title, char*indent);
 };
@@ -67,21 +278,208 @@ public:
 // Fast SVM
 //	Trains SVM with LibSVM, but uses optimized classification procedures.
 //	Implements feature value scaling internally.
+//	When trained with sparse examples, features are scaled by their maximal
+//	absolute value, so that zeros are preserved, and the model is applied
+//	with the sparse support vectors directly.
+
+/*
+fastSVMBatchMinRows
+	Smallest batch evaluated as a matrix product. Smaller batches are
+	classified row by row, as the column-major pass does not pay off.
+*/
+#define fastSVMBatchMinRows 8
+
+/*
+fastSVMCollapseMaxCubic
+	Largest number of features for which cubic kernel models are
+	collapsed into a polynomial. Quadratic models have no such limit.
+*/
+#define fastSVMCollapseMaxCubic 64
+
+/*
+fastSVMApproxErrorSamples
+	Largest number of training examples the error of approximate RBF
+	kernel models is measured on.
+*/
+#define fastSVMApproxErrorSamples 1000
+
+/*
+fastSVMReduceMinSize, fastSVMReduceMaxSize
+	Smallest and largest reduced support vector sets tried by
+	reduceSupportVectors. Sizes are doubled from the smallest.
+*/
+#define fastSVMReduceMinSize 16
+#define fastSVMReduceMaxSize 2048
+
+/*
+fastSVMDualCDMaxQuadratic
+	Largest number of features for which quadratic kernel models are
+	trained by trainDualCD, as the explicit feature map grows with the
+	square of the number of features.
+*/
+#define fastSVMDualCDMaxQuadratic 64
+
+/*
+fastSVMDualCDEps, fastSVMDualCDMaxIter
+	Stopping tolerance and largest number of passes over the training
+	examples of trainDualCD.
+*/
+#define fastSVMDualCDEps 0.1
+#define fastSVMDualCDMaxIter 1000
+
+/*
+fastSVMCascadeMaxPasses
+	Largest number of refinement passes of trainCascade.
+*/
+#define fastSVMCascadeMaxPasses 20
 
 class fastSVMClassifier:public baseClassifier{
 private:
-	svm_problem svmprob;		// LibSVM problem
+	svm_problem svmprob;		// LibSVM problem, pointing into trainingExamples
 	svm_parameter svmparam;	// LibSVM parameters
 	svm_model*svmmdl;			// LibSVM model
 	svm_node*svmvector;			// LibSVM hypervector
 	int nFeatures;
 	autofree<double> SVcoef;
-	float**mSVcoef;
+	float**mSVcoef;				// Support vectors (scaled, float), pointing into mSVcoefData
+	autofree<float> mSVcoefData;
+	autofree<svm_node> svData;	// Support vectors of svmmdl, packed by finalize
 	autofree<double> vMin, vMax;
+	autofree<double> vHalfRange, vScale;	// Per-feature scaling terms
 	autofree<float> fVec;
+	autofree<float> batchF;		// Scaled column-major batch (float)
+	autofree<double> batchD;		// Scaled column-major batch (double)
+	autofree<double> batchT;		// Per-row accumulators for batches
+	int batchCap;				// Rows there is room for in the batch buffers
+	bool sparse;				// True if trained with sparse examples
+	autofree<svm_node> sparseVec;	// Scaled sparse vector to classify
+	autofree<double> svNorm;	// Squared norms of support vectors (sparse RBF)
+	int polyDegree;				// Degree of the collapsed polynomial, or 0 if not collapsed
+	double polyB;				// Constant term of the collapsed polynomial
+	autofree<double> polyW;		// Linear terms of the collapsed polynomial
+	autofree<double> polyP;		// Packed higher order terms of the collapsed polynomial
+	int approxRank;				// Number of random Fourier features approximating an RBF model, or 0
+	autofree<double> approxOmega;	// Random frequencies, rank x nFeatures, with scaling folded in
+	autofree<double> approxPhase;	// Random phases, with scaling folded in
+	autofree<double> approxW;	// Weights of the random Fourier features
+	double approxMeanError;		// Mean absolute error of the approximation on training examples
+	double approxAgreement;		// Fraction of training examples classified as by the exact model
+	int reducedSize;			// Number of vectors in the reduced set, or 0 if not reduced
+	autofree<svm_node> reducedZ;	// Reduced set vectors (scaled), reducedSize x nFeatures
+	autofree<double> reducedBeta;	// Reduced set coefficients
+	double reducedMeanError;	// Mean absolute error of the reduced model on training examples
+	double reducedAgreement;	// Fraction of training examples classified as by the full model
+	std::vector<std::pair<int,double>> reducedTrials;	// Tried reduced set sizes, with their agreement
+	bool fixedScaling;			// True if the feature ranges were set with setScaling
+	int dualCDIter;				// Passes made by trainDualCD, or 0 if trained with LibSVM
+	int cascadeSets;			// Leaf subsets of trainCascade, or 0 if not trained as a cascade
+	int cascadePasses;			// Refinement passes made by trainCascade
 	fastSVMClassifier(int type,int nf,std::string _name);
-	bool IaddTrain(double*fv,double cls);
+	double applyScaledSparse(svm_node*v);
+	/*
+	collapsePoly
+		For polynomial kernels of degree 2 and 3, expands the decision
+		function into a polynomial of the unscaled features, with the
+		scaling folded into the terms, so that the cost of application
+		does not depend on the number of support vectors. Only done when
+		it is cheaper than evaluating the support vectors.
+	*/
+	bool collapsePoly();
+	double applyCollapsed(double*fv);
+	/*
+	approximateRBF
+		Turns an RBF kernel model into a linear model over random Fourier
+		features, cos(omega.x+phase), with omega drawn from the Fourier
+		transform of the kernel. The number of features is set with
+		-SVM:RBF:approx, and the error is measured against the exact
+		model on training examples.
+	*/
+	bool approximateRBF();
+	double applyApproxRBF(double*fv);
+	double applyExactScaled(svm_node*v);
+	/*
+	reduceSupportVectors
+		Replaces the support vectors of RBF and non-collapsed polynomial
+		models with a smaller reduced set. The reduced set is a subset of
+		the support vectors, with free support vectors first, and its
+		coefficients are fitted by least squares to the full model in
+		kernel feature space. Sizes are doubled until the fraction of
+		sampled training examples classified differently from the full
+		model is at most -SVM:reduce.
+	*/
+	bool reduceSupportVectors();
+	double applyReduced(double*fv);
+	/*
+	needsSupportVectors
+		Returns true if application or model output uses the support
+		vectors of svmmdl.
+	*/
+	bool needsSupportVectors();
+	/*
+	useDualCD
+		Returns true if the model is trained with trainDualCD: C-SVC and
+		epsilon-SVR models with linear kernels, or, with -SVM:DCD:quadratic,
+		quadratic kernels over at most fastSVMDualCDMaxQuadratic dense
+		features, with at least -SVM:DCD training examples.
+	*/
+	bool useDualCD();
+	/*
+	trainDualCD
+		Trains on svmprob by dual coordinate descent over the explicit
+		feature map of the kernel, as in LIBLINEAR, with the threshold as
+		a regularized bias term. Each pass takes time linear in the number
+		of training examples. The solution is returned as an equivalent
+		LibSVM model: for linear kernels, the weight vector as a single
+		support vector, and for quadratic kernels, the eigenvectors of the
+		quadratic form, and a pair of vectors for the linear terms.
+	*/
+	svm_model*trainDualCD();
+	/*
+	useCascade
+		Returns true if the model is trained with trainCascade: C-SVC and
+		epsilon-SVR models with more than -SVM:cascade training examples.
+	*/
+	bool useCascade();
+	/*
+	trainCascade
+		Trains disjoint subsets of at most -SVM:cascade examples of
+		svmprob, with the classes spread evenly, on all threads. The
+		support vectors of pairs of subsets are merged and retrained, until
+		one set is left. This is then refined by retraining its support
+		vectors together with the training examples violating the margin,
+		until there are none. Merged sets are warm started from the
+		coefficients of their support vectors, unless -SVM:cascade:cold is
+		given. The sv_indices of the returned model refer to svmprob.
+	*/
+	svm_model*trainCascade();
 public:
+	/*
+	getPolynomial
+		For linear models, and quadratic models collapsed by collapsePoly,
+		gets apply(v) as b + w.v + the packed quadratic terms P over pairs
+		i <= j of v, with scaling and threshold folded in. degree is set
+		to 1 or 2, and P to 0 for linear models. w must have room for
+		nFeatures values. Returns false if the model has no such form.
+	*/
+	bool getPolynomial(int&degree,double&b,double*w,double*&P);
+	/*
+	setScaling
+		Sets the feature ranges used for scaling, instead of the ranges of
+		the training examples. Must be called before training.
+	*/
+	void setScaling(double*min,double*max);
+	/*
+	isKernelExpansion
+		Returns true if the model is applied as a sum of kernel values over
+		the dense support vectors of getModel.
+	*/
+	bool isKernelExpansion();
+	inline svm_model*getModel(){ return svmmdl; }
+	/*
+	kernelScaled
+		Evaluates the kernel for two scaled dense vectors.
+	*/
+	double kernelScaled(svm_node*a,svm_node*b);
 	std::string name;
 	std::vector<std::string> featureNames;
 	~fastSVMClassifier();
@@ -89,7 +487,16 @@ public:
 	void scaleVector(svm_node*n);
 	void scaleVectorDoubleFloat(double*in,float*out);
 	bool do_train();
+	/*
+	finalize
+		Releases the LibSVM problem and the training examples. Support
+		vectors, which point into the training examples, are first packed
+		into svData, or dropped if the model is applied without them.
+	*/
+	void finalize();
 	double do_apply(double*fv);
+	void do_applyBatch(double*m,int n,double*out);
+	double do_applySparse(svm_node*v);
 	void printInfo(char*header);
 	bool exportAnalysisData(FILE*f, char*title, char*indent);
 };
@@ -114,21 +521,109 @@ private:
 	std::vector<MultiClassClassPair>borders;
 	deletevector<fastSVMClassifier>classifiers;
 	int nFeatures;
-	deletevector<baseClassifierSmp> trainingExamples;
+	autodelete<trainingMatrix> trainingExamples;
+	int nReleasedExamples;			// Number of training examples, once released after training
 	bool trained;
 	int svmtype;
+	autofree<double> batchScores;	// Border scores for a batch
+	autofree<int> batchVotes;		// Per-row class votes for a batch
+	autofree<int> batchActive;		// Rows of a batch with an undecided vote
+	autofree<double> batchRows;		// Undecided rows, gathered for batched border calls
+	int batchCap;					// Rows there is room for in the batch buffers
+	autofree<int> bordersLeft;		// Per border, the number of later borders of each class
+	int compiledDegree;				// Degree of the compiled borders, or 0 if not compiled
+	int compiledTerms;				// Number of terms of the compiled borders
+	autofree<double> compiledM;		// Term-major matrix of border coefficients
+	autofree<double> compiledB;		// Border constant terms
+	autofree<double> compiledZ;		// Terms of the vector to classify
+	autofree<double> compiledV;		// Border decision values
+	bool sharedScaling;				// True if all borders scale features the same way
+	std::vector<std::vector<int>> borderExamples;	// Per border, the index of each of its training examples
+	int poolSize;					// Number of pooled support vectors, or 0 if not pooled
+	autofree<svm_node> poolSV;		// Pooled support vectors (scaled), poolSize x nFeatures
+	autofree<int> poolStart;		// Per border, the first of its entries in poolIndex and poolCoef
+	autofree<int> poolIndex;		// Pooled support vector of each border coefficient
+	autofree<double> poolCoef;		// Border support vector coefficients
+	autofree<double> poolK;			// Kernel values of the pooled support vectors
+	autofree<unsigned int> poolKStamp;	// Value of poolStamp each entry of poolK was computed for
+	unsigned int poolStamp;			// Counts the vectors classified with the pool
+	autofree<svm_node> poolVec;		// Scaled vector to classify
+	autofree<int> poolVotes;		// Class votes for the vector to classify
 	//
 	MultiClassSVM(int nf,int _svmt,std::string _name);
+	/*
+	compile
+		Stacks the class borders into one matrix, if they are all linear or
+		collapsed quadratic models. The vector to classify and, for
+		quadratic models, its pairwise products are then computed once
+		for all borders, and a single matrix-vector product gives all
+		border decision values.
+	*/
+	bool compile();
+	/*
+	applyCompiled
+		Gets the winning class of a vector using the compiled borders.
+	*/
+	seqClass*applyCompiled(double*vec);
+	/*
+	poolSupportVectors
+		For kernel models over shared scaling, stores each unique support
+		vector once, with per-border coefficients, as in the multi-class
+		models of LibSVM. Kernel values are then computed once per vector
+		to classify, and reused by all borders.
+	*/
+	bool poolSupportVectors();
+	/*
+	applyPooled
+		Gets the winning class of a vector using the pooled support vectors.
+	*/
+	seqClass*applyPooled(double*vec);
+	/*
+	isVoteDecided
+		Returns true if the class with the most votes wins regardless of the
+		remaining votes. left holds the number of remaining borders per class.
+	*/
+	bool isVoteDecided(int*votes,int*left);
 public:
 	std::string name;
 	std::vector<std::string> featureNames;
+	bool keepTrainingExamples;		// If set, train keeps the training examples until releaseTrainingExamples
 	//
 	static MultiClassSVM*create(int _svmtype,int nfeatures,std::string _name);
 	~MultiClassSVM(){  }
 	//
 	bool addTrain(double*v,int vl,seqClass*c,double cE=0);
+	/*
+	train
+		Trains one model per class border. The border models are trained
+		concurrently. For exact RBF models and cubic models that are not
+		collapsed, support vectors are pooled if all borders scale features
+		the same way: if each border's ranges match those over all training
+		examples, or if -SVM:pool makes all borders use the latter.
+	*/
 	bool train();
+	int getNTrainingExamples();
+	/*
+	getTrainingVector
+		Gets training example i, while the training examples are kept.
+		See baseClassifier::getTrainingVector.
+	*/
+	double*getTrainingVector(int i,double*buf);
+	/*
+	releaseTrainingExamples
+		Releases the training examples, if kept after training.
+	*/
+	void releaseTrainingExamples();
 	seqClass*apply(double*vec,int vecl);
+	/*
+	applyBatch
+		Classifies the n rows of the row-major matrix m, with vecl values
+		per row, and stores the winning classes in out. Each class border
+		evaluates all rows in one batched call. Only the signs of border
+		decision values are needed, and rows are no longer evaluated once
+		the winning class is certain.
+	*/
+	bool applyBatch(double*m,int n,int vecl,seqClass**out);
 	void printInfo(char*header);
 	bool exportAnalysisData(FILE*f, char*title, char*indent);
 };
@@ -145,37 +640,41 @@ public:
 #include "../lib/ranger/src/Data.h"
 #include "../lib/ranger/src/DataDouble.h"
 
-class RangerData: public ranger::DataDouble {
+/*
+RangerData
+	Gives Ranger a read-only view of training examples stored in columns,
+	without copying them.
+*/
+class RangerData: public ranger::Data {
+private:
+	trainingMatrix*columns;
 public:
-	void setDataT(int nFeatures, std::vector<baseClassifierSmp*> dat) {
-		// Set header
-		for(int i=0;i<nFeatures;i++){
+	RangerData(){
+		columns = 0;
+	}
+	void setColumns(trainingMatrix*tc){
+		for(int i=0;i<tc->ncols;i++){
 			variable_names.push_back("f" + std::to_string(i+1));
 		}
 		num_cols = variable_names.size();
 		num_cols_no_snp = num_cols;
-		for(baseClassifierSmp*t: dat)
-			num_rows++;
-		reserveMemory(1);
-		bool error = false;
-		// Set rows
-		int row = 0;
-		for(baseClassifierSmp*t: dat){
-			for(int i=0;i<nFeatures;i++)
-				set_x(i, row, t->vec[i], error);
-			set_y(0, row, t->cls->flag ? 1. : -1., error);
-			row++;
+		num_rows = tc->nrows;
+		columns = tc;
+	}
+	double get_x(size_t row, size_t col) const override {
+		// Use permuted data for corrected impurity importance
+		if(col >= num_cols){
+			col = getUnpermutedVarID(col);
+			row = getPermutedSampleID(row);
 		}
+		return columns->getColumnValue(row, col);
 	}
-	void setVector(double*vec, int ncol){
-		num_rows = 1;
-		num_cols = ncol;
-		num_cols_no_snp = num_cols;
-		reserveMemory(0);
-		bool error = false;
-		for(int i=0;i<ncol;i++)
-			set_x(i, 0, vec[i], error);
+	double get_y(size_t row, size_t col) const override {
+		return columns->classes[row]->flag ? 1. : -1.;
 	}
+	void reserveMemory(size_t) override {}
+	void set_x(size_t, size_t, double, bool&) override {}
+	void set_y(size_t, size_t, double, bool&) override {}
 };
 
 class RangerRandomForest: public ranger::ForestProbability {
@@ -185,36 +684,89 @@ public:
 		computePredictionError();
 		dependent_variable_names.push_back(std::string("target"));
 	}
-	double predictVec(double*vec){
-		RangerData*rd = (RangerData*)data.get();
-		int ncol = rd->getNumCols();
-		rd->setVector(vec, ncol);
-		num_samples = 1;
-		ranger::equalSplit(thread_ranges, 0, num_trees - 1, num_threads);
-		predict();
-		double ppos = 0.;
-		double pneg = 0.;
-		for(int icls = 0; icls < class_values.size(); icls++){
-			if (class_values[icls] == 1.0)
-				ppos = predictions[0][0][icls];
-			else if (class_values[icls] == -1.0)
-				pneg = predictions[0][0][icls];
-		}
-		return ppos - pneg;
-	}
+};
+
+/*
+RFFlatForestQuickMaxLeaves
+	Largest number of leaves per tree for QuickScorer traversal.
+*/
+#define RFFlatForestQuickMaxLeaves 64
+
+/*
+RFFlatForest
+	A trained random forest, compiled for inference. The trees are
+	flattened into contiguous node arrays. Scores are the mean probability
+	of the positive class minus that of the negative class, as averaged
+	by Ranger. If no tree has more than RFFlatForestQuickMaxLeaves leaves,
+	vectors are scored with QuickScorer: the nodes of each feature are
+	sorted by split value, so that the nodes a vector goes right in are
+	found by a scan. Each clears the leaves of its left subtree from the
+	leaf bitvector of its tree, and the exit leaf of each tree is then the
+	lowest remaining bit.
+*/
+class RFFlatForest{
+private:
+	int nTrees,nFeatures;
+	autofree<int> treeRoot;			// First node of each tree
+	autofree<int> nodeFeature;		// Split feature of each node, or -1 for leaves
+	autofree<double> nodeSplit;		// Split value. Vectors go left if not greater.
+	autofree<int> nodeLeft,nodeRight;	// Children
+	autofree<double> nodePos,nodeNeg;	// Class probabilities of leaves
+	bool quick;						// True if scored with QuickScorer
+	autofree<int> quickFeatureStart;	// Per feature, the first of its nodes in the quick arrays, and the end
+	autofree<double> quickSplit;	// Split values, increasing per feature
+	autofree<int> quickTree;		// Tree of each node
+	autofree<uint64_t> quickMask;	// Leaves that remain reachable if a vector goes right
+	autofree<int> quickLeafStart;	// Per tree, its first leaf in quickPos and quickNeg
+	autofree<double> quickPos,quickNeg;	// Class probabilities of leaves, left to right per tree
+	autofree<uint64_t> quickBits;	// Per tree leaf bitvectors while scoring
+	autofree<double> batchPos,batchNeg;	// Per-row sums for a batch
+	int batchCap;					// Rows there is room for in the batch buffers
+	//
+	RFFlatForest();
+	/*
+	compileQuick
+		Lays out the flattened trees for QuickScorer, if they are shallow enough.
+	*/
+	bool compileQuick();
+	double applyQuick(double*vec);
+public:
+	/*
+	create
+		Call to construct, from a trained forest.
+	*/
+	static RFFlatForest*create(RangerRandomForest*rf,int nf);
+	double apply(double*vec);
+	/*
+	applyBatch
+		Scores the n rows of the row-major matrix m into out. Without
+		QuickScorer, each tree scores all rows before the next.
+	*/
+	bool applyBatch(double*m,int n,double*out);
+	inline bool isQuick(){ return quick; }
+	inline int getNTrees(){ return nTrees; }
+	inline int getNNodes(){ return treeRoot[nTrees]; }
 };
 
 class RFClassifier:public baseClassifier{
 private:
 	RFClassifier(int nf);
 	autodelete<RangerRandomForest> rf;
+	autodelete<RFFlatForest> flat;
 	std::string name;
 public:
 	std::vector<std::string> featureNames;
 	virtual ~RFClassifier(){ };
 	static RFClassifier*create(int nf, std::string name);
 	bool do_train();
+	/*
+	finalize
+		Releases the Ranger forest and the training examples, as the
+		flattened forest is applied instead.
+	*/
+	void finalize();
 	double do_apply(double*vec);
+	void do_applyBatch(double*m,int n,double*out);
 	void printInfo(char*header);
 };
 
@@ -44,6 +44,10 @@ DummyPREdictor*DummyPREdictor::create(motifList*motifs){
 	if(!r.ptr->mwin.ptr){
 		return 0;
 	}
+	r.ptr->pairs.ptr = motifPairCounter::create(r.ptr->mwin.ptr,219);
+	if(!r.ptr->pairs.ptr){
+		return 0;
+	}
 	r.ptr->moc=r.ptr->mwin.ptr->occContainer;
 	r.ptr->motifs=r.ptr->mwin.ptr->motifs;
 	if(!r.ptr->fvec.resize((size_t)nfeatures)){
@@ -53,32 +57,12 @@ DummyPREdictor*DummyPREdictor::create(motifList*motifs){
 }
 
 int DummyPREdictor::getNPair(int ia,int ib){
-	int nPairCut=219;
-	int iv=0;
 	if(ia==ib){
 		if(!cfg->allowHomoPairing)return 0;
-		motifOcc*o=moc->getFirst(ia);
-		while(o){
-			motifOcc*o2=o;
-			while(o2){
-				if(isMotifPair(o,o2,0,nPairCut))iv++;
-				o2=moc->getNextSame(o2);
-			}
-			o=moc->getNextSame(o);
-		}
 	}else{
 		if(!cfg->allowHeteroPairing)return 0;
-		motifOcc*o=moc->getFirst(ia);
-		while(o){
-			motifOcc*o2=moc->getFirst(ib);
-			while(o2){
-				if(isMotifPair(o,o2,0,nPairCut))iv++;
-				o2=moc->getNextSame(o2);
-			}
-			o=moc->getNextSame(o);
-		}
 	}
-	return iv;
+	return pairs.ptr->getNPair(ia,ib);
 }
 
 bool DummyPREdictor::trainWindow(char*buf,long long pos,int bufs,seqClass*cls){
@@ -94,7 +78,7 @@ bool DummyPREdictor::flush(){
 }
 
 double DummyPREdictor::do_applyWindow(char*buf,long long pos,int bufs){
-	if(!mwin.ptr->readWindow(buf,pos,bufs)){
+	if(!pairs.ptr->readWindow(buf,pos,bufs)){
 		return false;
 	}
 	int nm=motifs->nmotifs;
@@ -14,6 +14,7 @@
 class DummyPREdictor:public sequenceClassifier{
 private:
 	autodelete<motifWindow> mwin;
+	autodelete<motifPairCounter> pairs;
 	motifOccContainer*moc;
 	motifList*motifs;
 	autofree<double> fvec;
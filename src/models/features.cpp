@@ -79,6 +79,7 @@ featureSet::featureSet(){
 	nifeatures=0;
 	ifeatures.ptr=0;
 	instantiated=false;
+	npairTables=0;
 }
 
 featureSet::~featureSet(){
@@ -115,6 +116,12 @@ featureSetFeature*featureSet::addFeature(featureType _f,int ia,int ib,int ic,dou
 void featureSet::uninstantiate(){
 	instantiated=false;
 	nifeatures=0;
+	pairGroups.clear();
+	pairTerms.clear();
+	pairGroupsByMotif.clear();
+	npairTables=0;
+	occFeaturesByMotif.clear();
+	otherFeatures.clear();
 }
 
 featureSetInstFeature*featureSet::addInstFeature(featureSetFeature*bf,int ia,int ib,int ic,int icf){
@@ -204,10 +211,122 @@ bool featureSet::instantiate(motifList*ml){
 		if(!instantiateFeature(f,ml))
 			return false;
 	}
+	if(!compilePairFeatures(ml))
+		return false;
+	indexOccurrenceFeatures(ml);
 	instantiated=true;
 	return true;
 }
 
+bool featureSet::isCompiledPairFeature(featureType f){
+	return f==featureType_nPair||f==featureType_nPairDH||f==featureType_nPair2D;
+}
+
+bool featureSet::isOccurrenceFeature(featureType f){
+	return f==featureType_nOcc||f==featureType_nOccPair||f==featureType_PEDI||isCompiledPairFeature(f);
+}
+
+void featureSet::indexOccurrenceFeatures(motifList*ml){
+	occFeaturesByMotif.assign(ml->nmotifs,std::vector<int>());
+	otherFeatures.clear();
+	featureSetInstFeature*fsif=ifeatures;
+	for(int l=0;l<nifeatures;l++,fsif++){
+		if(isOccurrenceFeature(fsif->fsf->f))occFeaturesByMotif[fsif->ia].push_back(l);
+		else otherFeatures.push_back(l);
+	}
+}
+
+bool featureSet::compilePairFeatures(motifList*ml){
+	pairGroups.clear();
+	pairTerms.clear();
+	npairTables=0;
+	pairGroupsByMotif.assign(ml->nmotifs,std::vector<int>());
+	/*
+		Collect terms per motif pair, and size the lookup tables.
+		Tables are indexed by twice the center distance, which is always
+		an integer, since motif occurrence centers are at half-integer
+		positions.
+	*/
+	int nm=ml->nmotifs;
+	std::vector<int> groupIndex(nm*nm,-1);
+	std::vector<std::vector<featurePairTerm>> groupTerms;
+	featureSetInstFeature*fsif=ifeatures;
+	for(int l=0;l<nifeatures;l++,fsif++){
+		featureSetFeature*fsf=fsif->fsf;
+		if(!isCompiledPairFeature(fsf->f))continue;
+		int key=fsif->ia*nm+fsif->ib;
+		if(groupIndex[key]==-1){
+			featurePairGroup g;
+			g.ia=fsif->ia;
+			g.ib=fsif->ib;
+			g.maxCut=0;
+			g.iterm=g.nterm=0;
+			groupIndex[key]=int(pairGroups.size());
+			pairGroupsByMotif[g.ia].push_back(groupIndex[key]);
+			if(g.ib!=g.ia)pairGroupsByMotif[g.ib].push_back(groupIndex[key]);
+			pairGroups.push_back(g);
+			groupTerms.push_back(std::vector<featurePairTerm>());
+		}
+		featurePairGroup&g=pairGroups[groupIndex[key]];
+		featurePairTerm t;
+		t.f=fsf->f;
+		t.ifeature=l;
+		t.cut=int(fsf->da);
+		t.axis=fsif->icf&2;
+		t.itable=0;
+		if(t.cut<0)t.cut=-1;
+		t.tcut=min(t.cut,featurePairTableMaxCut);
+		if(t.cut>g.maxCut)g.maxCut=t.cut;
+		if(t.tcut>=0){
+			if(t.f==featureType_nPair2D){
+				// Cosine and sine for distances 0 to tcut
+				t.itable=npairTables;
+				npairTables+=(2*t.tcut+1)*2;
+			}else if(t.f==featureType_nPairDH){
+				// Same strand and opposite strand for distances -tcut to tcut
+				t.itable=npairTables;
+				npairTables+=(4*t.tcut+1)*2;
+			}
+		}
+		groupTerms[groupIndex[key]].push_back(t);
+	}
+	for(size_t l=0;l<pairGroups.size();l++){
+		pairGroups[l].iterm=int(pairTerms.size());
+		pairGroups[l].nterm=int(groupTerms[l].size());
+		pairTerms.insert(pairTerms.end(),groupTerms[l].begin(),groupTerms[l].end());
+	}
+	if(!npairTables)return true;
+	if(!pairTables.resize(npairTables))return false;
+	/*
+		Fill lookup tables. Values are computed with the same expressions
+		as the direct evaluation, so results are unchanged.
+	*/
+	for(featurePairTerm&t:pairTerms){
+		if(t.tcut<0)continue;
+		if(t.f==featureType_nPair2D){
+			double freq=ifeatures[t.ifeature].fsf->db;
+			int n=2*t.tcut+1;
+			double*tcos=pairTables.ptr+t.itable;
+			double*tsin=tcos+n;
+			for(int i=0;i<n;i++){
+				double ph=(double(i)/2.0)/freq;
+				tcos[i]=cos(ph*3.141592654*2.0);
+				tsin[i]=sin(ph*3.141592654*2.0);
+			}
+		}else if(t.f==featureType_nPairDH){
+			int n=4*t.tcut+1;
+			double*tsame=pairTables.ptr+t.itable;
+			double*topp=tsame+n;
+			for(int i=0;i<n;i++){
+				double d_gamma=double(i-2*t.tcut)/2.0;
+				tsame[i]=cos(((d_gamma+0.0)/10.5)*3.141592654*2.0)+1.0;
+				topp[i]=cos(((d_gamma+5.25)/10.5)*3.141592654*2.0)+1.0;
+			}
+		}
+	}
+	return true;
+}
+
 bool featureSet::skipUnusedMotifs(motifList*ml){
 	if(!instantiated){
 		cmdError("Feature set not instantiated.");
@@ -345,6 +464,10 @@ std::vector<std::string> featureSet::getInstFeatureNames(motifList*ml){
 featureWindow::featureWindow(motifWindow*mw,featureSet*fs){
 	cfg=getConfiguration();
 	fvec=0;
+	accPos=0;
+	accLen=0;
+	nIncremental=0;
+	svecCap=0;
 	features=fs;
 	mwin=mw;
 	motifs=mw->motifs;
@@ -376,6 +499,15 @@ featureWindow*featureWindow::create(motifWindow*mw,featureSet*fs){
 		delete r;
 		return 0;
 	}
+	for(int l=0;l<fs->nfeatures;l++){
+		if(fs->features[l].f==featureType_GC){
+			if(!mw->enableCompositionIndex()){
+				delete r;
+				return 0;
+			}
+			break;
+		}
+	}
 	int nf=fs->nifeatures;
 	if(!nf){
 		cmdError("Empty feature set.");
@@ -388,6 +520,10 @@ featureWindow*featureWindow::create(motifWindow*mw,featureSet*fs){
 		delete r;
 		return 0;
 	}
+	if(!r->accum.resize(nf)||!r->nOccM.resize(mw->motifs->nmotifs)){
+		delete r;
+		return 0;
+	}
 	return r;
 }
 
@@ -559,28 +695,177 @@ int featureWindow::getNFeatures(){
 	return features->nifeatures;
 }
 
-double*featureWindow::extractFeatures(char*wseq,long long wpos,int wlen,bool doRead){
+void featureWindow::addPairTerms(featurePairGroup&g,motifOcc*o,motifOcc*o2,double w){
+	int d1=int(o2->start-(o->start+o->mot->len));
+	int d2=int(o->start-(o2->start+o2->mot->len));
+	int d_alpha=max(max(d1,d2),0);
+	// The gap never exceeds the center distance, so this bounds all terms.
+	if(d_alpha>g.maxCut)return;
+	// Twice the signed center distance
+	int D=int((o2->start*2+o2->mot->len)-(o->start*2+o->mot->len));
+	int aD=D<0?-D:D;
+	bool homo=g.ia==g.ib;
+	double*tables=features->pairTables;
+	featurePairTerm*t=features->pairTerms.data()+g.iterm,*te=t+g.nterm;
+	for(;t<te;t++){
+		switch(t->f){
+			case featureType_nPair:{
+				if(d_alpha<=t->cut)accum[t->ifeature]+=w;
+				break;}
+			case featureType_nPair2D:{
+				if(aD>2*t->cut)break;
+				double v;
+				if(aD<=2*t->tcut){
+					int n=2*t->tcut+1;
+					v=t->axis?tables[t->itable+n+aD]:tables[t->itable+aD];
+				}else{
+					double ph=(double(aD)/2.0)/features->ifeatures[t->ifeature].fsf->db;
+					v=t->axis?sin(ph*3.141592654*2.0):cos(ph*3.141592654*2.0);
+				}
+				if(t->axis){
+					// Sine is odd in the phase
+					if(homo){
+						if(features->ifeatures[t->ifeature].fsf->db<0)v=-v;
+					}else{
+						if((D<0)!=bool(o->strand))v=-v;
+					}
+				}
+				accum[t->ifeature]+=w*v;
+				break;}
+			case featureType_nPairDH:{
+				if(aD>2*t->cut)break;
+				bool opp=o->strand!=o2->strand;
+				if(aD<=2*t->tcut){
+					int n=4*t->tcut+1;
+					accum[t->ifeature]+=w*tables[t->itable+(opp?n:0)+D+2*t->tcut];
+				}else{
+					double phaseshift=opp?5.25:0;
+					accum[t->ifeature]+=w*(cos(((double(D)/2.0+phaseshift)/10.5)*3.141592654*2.0)+1.0);
+				}
+				break;}
+			default:;
+		}
+	}
+}
+
+void featureWindow::evaluateAll(){
+	int nm=motifs->nmotifs;
+	for(int l=0;l<nm;l++){
+		int n=0;
+		motifOcc*o=occContainer->getFirst(l);
+		while(o){
+			if(!o->skip)n++;
+			o=occContainer->getNextSame(o);
+		}
+		nOccM[l]=n;
+	}
+	for(int m=0;m<nm;m++)if(nOccM[m])for(int gi:features->pairGroupsByMotif[m]){
+		featurePairGroup&g=features->pairGroups[gi];
+		if(g.ia!=m||!nOccM[g.ib])continue;
+		featurePairTerm*t=features->pairTerms.data()+g.iterm,*te=t+g.nterm;
+		for(;t<te;t++)accum[t->ifeature]=0;
+		bool homo=g.ia==g.ib;
+		motifOcc*o=occContainer->getFirst(g.ia),*o2,*no;
+		while(o){
+			no=occContainer->getNextSame(o);
+			if(o->skip){o=no;continue;}
+			// Homotypic pairs are counted once, heterotypic pairs in both orders.
+			o2=homo?no:occContainer->getFirst(g.ib);
+			while(o2){
+				if(!o2->skip)addPairTerms(g,o,o2,1.0);
+				o2=occContainer->getNextSame(o2);
+			}
+			o=no;
+		}
+	}
+}
+
+void featureWindow::resetPairSums(int m){
+	if(nOccM[m])return;
+	for(int gi:features->pairGroupsByMotif[m]){
+		featurePairGroup&g=features->pairGroups[gi];
+		featurePairTerm*t=features->pairTerms.data()+g.iterm,*te=t+g.nterm;
+		for(;t<te;t++)accum[t->ifeature]=0;
+	}
+}
+
+void featureWindow::updateOccurrence(motifOcc*n,double w,long long changeStart,long long changeEnd){
+	if(n->skip)return;
+	int t=n->mot->index;
+	nOccM[t]+=w>0?1:-1;
+	for(int gi:features->pairGroupsByMotif[t]){
+		featurePairGroup&g=features->pairGroups[gi];
+		bool homo=g.ia==g.ib;
+		motifOcc*x=occContainer->getFirst(t==g.ia?g.ib:g.ia);
+		for(;x;x=occContainer->getNextSame(x)){
+			if(x==n||x->skip)continue;
+			// Pairs of two changed occurrences are handled from the first one.
+			if((x->start<changeStart||x->start+x->mot->len>changeEnd)&&x>n)continue;
+			if(homo){
+				// Homotypic pairs are evaluated with the later occurrence first,
+				// matching the list order used by evaluateAll.
+				if(n->start>=x->start)addPairTerms(g,n,x,w);
+				else addPairTerms(g,x,n,w);
+			}else if(t==g.ia){
+				addPairTerms(g,n,x,w);
+			}else{
+				addPairTerms(g,x,n,w);
+			}
+		}
+	}
+}
+
+bool featureWindow::update(char*wseq,long long wpos,int wlen,bool doRead){
 	if(doRead){
+		// Update incrementally if the window overlaps the one the sums are valid for.
+		bool incremental=accLen&&mwin->wPos==accPos&&mwin->wLen==accLen
+			&&wpos>=accPos&&wpos<accPos+accLen&&nIncremental<featureIncrementalResync;
+		long long prevEnd=mwin->wPos+mwin->wLen;
+		accLen=0;
+		if(incremental){
+			motifOcc*o=occContainer->getFirst();
+			for(;o;o=occContainer->getNext(o)){
+				if(o->start<wpos)updateOccurrence(o,-1.0,wpos,LLONG_MAX);
+			}
+		}
 		if(!mwin->readWindow(wseq,wpos,wlen)){
-			return 0;
+			return false;
 		}
+		if(incremental){
+			motifOcc*o=occContainer->getFirst();
+			for(;o;o=occContainer->getNext(o)){
+				if(o->start+o->mot->len>prevEnd&&!o->skip)resetPairSums(o->mot->index);
+			}
+			for(o=occContainer->getFirst();o;o=occContainer->getNext(o)){
+				if(o->start+o->mot->len>prevEnd)updateOccurrence(o,1.0,LLONG_MIN,prevEnd);
+			}
+			nIncremental++;
+		}else{
+			evaluateAll();
+			nIncremental=0;
+		}
+	}else{
+		evaluateAll();
+		nIncremental=0;
 	}
+	accPos=mwin->wPos;
+	accLen=mwin->wLen;
+	return true;
+}
+
+bool featureWindow::evaluateFeatures(int*ls,int n,long long wpos,int wlen,double*out){
 	featureSetFeature*fsf;
-	featureSetInstFeature*fsif=features->ifeatures;
+	featureSetInstFeature*fsif;
 	double v;
 	int iv;
 	double normv=1.0/double(wlen);
-	for(int l=0;l<features->nifeatures;l++,fsif++){
+	for(int x=0;x<n;x++){
+		int l=ls?ls[x]:x;
+		fsif=features->ifeatures+l;
 		fsf=fsif->fsf;
 		switch(fsf->f){
 			case featureType_nOcc:{
-				int n=0;
-				motifOcc*o=occContainer->getFirst(fsif->ia);
-				while(o){
-					if(!o->skip)n++;
-					o=occContainer->getNextSame(o);
-				}
-				v=double(n)*normv;
+				v=double(nOccM[fsif->ia])*normv;
 				break;}
 			case featureType_nOccPair:{
 				iv=0;
@@ -608,133 +893,12 @@ double*featureWindow::extractFeatures(char*wseq,long long wpos,int wlen,bool doR
 				}
 				v=double(iv)*normv;
 				break;}
-			case featureType_nPair:{
-				iv=0;
-				int nPairCut=int(fsf->da);
-				// New
-				if(fsif->ia==fsif->ib){
-					motifOcc*o=occContainer->getFirst(fsif->ia),*o2,*no;
-					while(o){
-						if(o->skip){o=occContainer->getNextSame(o);continue;}
-						no=o2=occContainer->getNextSame(o);
-						while(o2){
-							if(o2->skip){o2=occContainer->getNextSame(o2);continue;}
-							int d1=int(o2->start-(o->start+o->mot->len));
-							int d2=int(o->start-(o2->start+o2->mot->len));
-							int d_alpha=max(max(d1,d2),0);
-							if(d_alpha<=nPairCut){
-								iv++;
-							}
-							o2=occContainer->getNextSame(o2);
-						}
-						o=no;
-					}
-				}else{
-					motifOcc*o=occContainer->getFirst(fsif->ia);
-					while(o){
-						if(o->skip){o=occContainer->getNextSame(o);continue;}
-						motifOcc*o2=occContainer->getFirst(fsif->ib);
-						while(o2){
-							if(o2->skip){o2=occContainer->getNextSame(o2);continue;}
-							int d1=int(o2->start-(o->start+o->mot->len));
-							int d2=int(o->start-(o2->start+o2->mot->len));
-							int d_alpha=max(max(d1,d2),0);
-							if(d_alpha<=nPairCut){
-								iv++;
-							}
-							o2=occContainer->getNextSame(o2);
-						}
-						o=occContainer->getNextSame(o);
-					}
-				}
-				v=double(iv)*normv;
-				break;}
+			case featureType_nPair:
 			case featureType_nPair2D:{
-				double s=0;
-				bool axis=fsif->icf&2;
-				double freq=fsf->db;
-				int nPairCut=int(fsf->da);
-				if(fsif->ia==fsif->ib){
-					motifOcc*o=occContainer->getFirst(fsif->ia),*o2,*no;
-					while(o){
-						if(o->skip){o=occContainer->getNextSame(o);continue;}
-						no=o2=occContainer->getNextSame(o);
-						while(o2){
-							if(o2->skip){o2=occContainer->getNextSame(o2);continue;}
-							double d_gamma=(double(o2->start)+double(o2->mot->len)/2.0)
-												-(double(o->start)+double(o->mot->len)/2.0);
-							if(d_gamma<0)d_gamma=-d_gamma;
-							if(d_gamma<=nPairCut){
-								double ph=d_gamma/freq;
-								if(ph<0)ph=-ph;
-								s+=axis?sin(ph*3.141592654*2.0):cos(ph*3.141592654*2.0);
-							}
-							o2=occContainer->getNextSame(o2);
-						}
-						o=no;
-					}
-				}else{
-					motifOcc*o=occContainer->getFirst(fsif->ia);
-					while(o){
-						if(o->skip){o=occContainer->getNextSame(o);continue;}
-						motifOcc*o2=occContainer->getFirst(fsif->ib);
-						while(o2){
-							if(o2->skip){o2=occContainer->getNextSame(o2);continue;}
-							double d_gamma=(double(o2->start)+double(o2->mot->len)/2.0)
-												-(double(o->start)+double(o->mot->len)/2.0);
-							if(d_gamma<=nPairCut&&d_gamma>=-nPairCut){
-								double ph=d_gamma/freq;
-								if(o->strand)ph=-ph;
-								s+=axis?sin(ph*3.141592654*2.0):cos(ph*3.141592654*2.0);
-							}
-							o2=occContainer->getNextSame(o2);
-						}
-						o=occContainer->getNextSame(o);
-					}
-				}
-				v=s*normv;
+				v=nOccM[fsif->ia]&&nOccM[fsif->ib]?accum[l]*normv:0;
 				break;}
 			case featureType_nPairDH:{
-				v=0;
-				int nPairCut=int(fsf->da);
-				if(fsif->ia==fsif->ib){
-					motifOcc*o=occContainer->getFirst(fsif->ia),*o2,*no;
-					while(o){
-						if(o->skip){o=occContainer->getNextSame(o);continue;}
-						no=o2=occContainer->getNextSame(o);
-						while(o2){
-							if(o2->skip){o2=occContainer->getNextSame(o2);continue;}
-							double d_gamma=(double(o2->start)+double(o2->mot->len)/2.0)
-												-(double(o->start)+double(o->mot->len)/2.0);
-							if(d_gamma<=nPairCut&&d_gamma>=-nPairCut){
-								double phaseshift=0;
-								if(o->strand!=o2->strand)phaseshift=5.25;
-								v+=cos(((double(d_gamma)+phaseshift)/10.5)*3.141592654*2.0)+1.0;
-							}
-							o2=occContainer->getNextSame(o2);
-						}
-						o=no;
-					}
-				}else{
-					motifOcc*o=occContainer->getFirst(fsif->ia);
-					while(o){
-						if(o->skip){o=occContainer->getNextSame(o);continue;}
-						motifOcc*o2=occContainer->getFirst(fsif->ib);
-						while(o2){
-							if(o2->skip){o2=occContainer->getNextSame(o2);continue;}
-							double d_gamma=(double(o2->start)+double(o2->mot->len)/2.0)
-												-(double(o->start)+double(o->mot->len)/2.0);
-							if(d_gamma<=nPairCut&&d_gamma>=-nPairCut){
-								double phaseshift=0;
-								if(o->strand!=o2->strand)phaseshift=5.25;
-								v+=cos(((double(d_gamma)+phaseshift)/10.5)*3.141592654*2.0)+1.0;
-							}
-							o2=occContainer->getNextSame(o2);
-						}
-						o=occContainer->getNextSame(o);
-					}
-				}
-				v*=normv/2.0;
+				v=nOccM[fsif->ia]&&nOccM[fsif->ib]?accum[l]*(normv/2.0):0;
 				break;}
 			case featureType_PEDI:{
 				v=0;
@@ -785,17 +949,61 @@ double*featureWindow::extractFeatures(char*wseq,long long wpos,int wlen,bool doR
 				v=getMDM(fsif->ia,fsif->ib);
 				break;}
 			case featureType_GC:{
-				char*c=wseq;
-				int gc=0;
-				for(int i=0;i<wlen;i++,c++){
-					if(*c=='G'||*c=='C')gc++;
-				}
-				v=double(gc)/double(wlen);
+				v=double(mwin->composition->getGC(wpos,wpos+wlen))/double(wlen);
 				break;}
-			default:cmdError("Unsupported feature."); return 0;
+			default:cmdError("Unsupported feature."); return false;
 		}
-		fvec[l]=v;
+		out[x]=v;
 	}
+	return true;
+}
+
+double*featureWindow::extractFeatures(char*wseq,long long wpos,int wlen,bool doRead){
+	if(!update(wseq,wpos,wlen,doRead))return 0;
+	if(!evaluateFeatures(0,features->nifeatures,wpos,wlen,fvec))return 0;
 	return fvec;
 }
 
+int featureWindow::extractFeaturesSparse(char*wseq,long long wpos,int wlen,svm_node*&out){
+	if(!update(wseq,wpos,wlen,true))return -1;
+	// Candidates: features that do not depend on occurrences, and
+	// features of which all motifs occur in the window.
+	int nm=motifs->nmotifs;
+	scand.assign(features->otherFeatures.begin(),features->otherFeatures.end());
+	for(int m=0;m<nm;m++){
+		if(!nOccM[m])continue;
+		for(int i:features->occFeaturesByMotif[m]){
+			int ib=features->ifeatures[i].ib;
+			if(ib==featureMotif_All||nOccM[ib])scand.push_back(i);
+		}
+	}
+	std::sort(scand.begin(),scand.end());
+	int nc=int(scand.size());
+	if(nc+1>svecCap){
+		if(!svec.resize(nc+1)||!svals.resize(nc))return -1;
+		svecCap=nc+1;
+	}
+	if(!evaluateFeatures(scand.data(),nc,wpos,wlen,svals))return -1;
+	int nnz=0;
+	for(int x=0;x<nc;x++){
+		if(svals[x]==0)continue;
+		svec[nnz].index=scand[x];
+		svec[nnz].value=svals[x];
+		nnz++;
+	}
+	svec[nnz].index=-1;
+	svec[nnz].value=0;
+	out=svec.ptr;
+	return nnz;
+}
+
+bool featureWindow::extractFeaturesBatch(char**wseqs,long long*wpos,int*wlens,int n,double*out){
+	int nf=features->nifeatures;
+	for(int x=0;x<n;x++,out+=nf){
+		double*fv=extractFeatures(wseqs[x],wpos[x],wlens[x],true);
+		if(!fv)return false;
+		memcpy(out,fv,sizeof(double)*nf);
+	}
+	return true;
+}
+
@@ -56,6 +56,34 @@ typedef struct{
 	int icf;				// Cardinality factor index
 }featureSetInstFeature;
 
+/*
+featurePairTerm
+	A compiled pair feature: accumulates into one instantiated feature.
+	Trigonometric terms are read from a lookup table in the feature set,
+	indexed by twice the motif occurrence center distance.
+*/
+#define featurePairTableMaxCut 16384
+
+typedef struct{
+	featureType f;			// Type of feature
+	int ifeature;			// Index of the instantiated feature
+	int cut;				// Distance cutoff
+	int tcut;				// Largest distance covered by the lookup table
+	bool axis;				// Y-axis (nPair2D)
+	long itable;			// Offset of the lookup table (nPair2D and nPairDH)
+}featurePairTerm;
+
+/*
+featurePairGroup
+	Pair features for one motif pair, evaluated in a single pass over
+	the motif occurrence pairs.
+*/
+typedef struct{
+	int ia,ib;				// Motif indices
+	int maxCut;				// Largest distance cutoff of the terms
+	int iterm,nterm;		// Range of terms
+}featurePairGroup;
+
 /*
 featureSet
 	Holds a feature set.
@@ -70,6 +98,13 @@ public:
 	autofree<featureSetInstFeature> ifeatures;	// Instantiated features
 	int nifeatures;								// Number of instantiated features
 	bool instantiated;							// True if instantiated
+	std::vector<featurePairGroup> pairGroups;	// Compiled pair feature groups
+	std::vector<featurePairTerm> pairTerms;		// Compiled pair feature terms
+	std::vector<std::vector<int>> pairGroupsByMotif;	// Indices of the pair groups each motif takes part in
+	autofree<double> pairTables;				// Lookup tables for compiled pair features
+	long npairTables;							// Length of pairTables
+	std::vector<std::vector<int>> occFeaturesByMotif;	// Features that are zero without occurrences, by first motif index
+	std::vector<int> otherFeatures;				// Features that can be non-zero without occurrences
 	~featureSet();
 	/*
 	create
@@ -104,6 +139,31 @@ public:
 		Instantiates the feature set for the specified motifList.
 	*/
 	bool instantiate(motifList*ml);
+	/*
+	compilePairFeatures
+		Groups instantiated nPair, nPairDH and nPair2D features by motif
+		pair, so that distances are computed once per occurrence pair.
+		Called by instantiate.
+	*/
+	bool compilePairFeatures(motifList*ml);
+	/*
+	isCompiledPairFeature
+		Returns true if the feature type is evaluated via pairGroups.
+	*/
+	static bool isCompiledPairFeature(featureType f);
+	/*
+	isOccurrenceFeature
+		Returns true if the feature type is zero for windows without
+		occurrences of each of its motifs.
+	*/
+	static bool isOccurrenceFeature(featureType f);
+	/*
+	indexOccurrenceFeatures
+		Fills occFeaturesByMotif and otherFeatures, so that sparse
+		feature vectors can be extracted from the motifs that occur.
+		Called by instantiate.
+	*/
+	void indexOccurrenceFeatures(motifList*ml);
 	bool skipUnusedMotifs(motifList*ml);
 	/*
 	printInfo
@@ -129,10 +189,23 @@ public:
 ////////////////////////////////////////////////////////////////////////////////////
 // Feature window
 
+/*
+featureIncrementalResync
+	Maximal number of consecutive incremental feature updates before the
+	features are fully re-evaluated, bounding floating point drift in
+	the oscillatory pair feature sums.
+*/
+#define featureIncrementalResync 1000
+
 /*
 featureWindow
 	Used to extract features from a sequence based on motifs.
 	Constructed for a particular combination of features and motifs.
+	When consecutive windows overlap, occurrence counts and compiled pair
+	features are updated incrementally from the occurrences that leave
+	and enter the window. Other features are evaluated for every window.
+	Compiled pair feature sums are only kept up to date for motif pairs
+	that both occur in the window.
 */
 class featureWindow{
 private:
@@ -142,9 +215,54 @@ private:
 	motifOccContainer*occContainer;		// Motif occurrence container for the window
 	motifWindow*mwin;
 	double*fvec;
+	autofree<double> accum;				// Unnormalized compiled pair feature sums
+	autofree<int> nOccM;				// Per-motif occurrence counts
+	long long accPos;					// Window position the sums are valid for
+	int accLen;							// Window length the sums are valid for. 0 if invalid.
+	int nIncremental;					// Incremental updates since last full evaluation
+	autofree<svm_node> svec;			// Sparse feature vector
+	autofree<double> svals;				// Values of the sparse feature candidates
+	int svecCap;						// Number of entries there is room for in svec
+	std::vector<int> scand;				// Sparse feature candidates
 	
 	// Private constructor
 	featureWindow(motifWindow*mw,featureSet*fs);
+	/*
+	addPairTerms
+		Adds w times the contribution of an occurrence pair to the
+		accumulated sums of a pair group. o must be of type g.ia.
+	*/
+	void addPairTerms(featurePairGroup&g,motifOcc*o,motifOcc*o2,double w);
+	/*
+	resetPairSums
+		Clears the compiled pair feature sums of motif m, if it does not
+		occur in the window, so that they can be accumulated from scratch.
+	*/
+	void resetPairSums(int m);
+	/*
+	updateOccurrence
+		Adds w times the contribution of occurrence n, and of its pairs
+		with the other occurrences. Pairs with other changed occurrences,
+		as indicated by changeStart and changeEnd, are only counted once.
+	*/
+	void updateOccurrence(motifOcc*n,double w,long long changeStart,long long changeEnd);
+	/*
+	evaluateAll
+		Evaluates occurrence counts and compiled pair features from scratch.
+	*/
+	void evaluateAll();
+	/*
+	update
+		Reads the window if doRead is set, and brings occurrence counts and
+		compiled pair feature sums up to date.
+	*/
+	bool update(char*wseq,long long wpos,int wlen,bool doRead);
+	/*
+	evaluateFeatures
+		Evaluates the instantiated features ls[0..n-1] for the current
+		window into out. If ls is null, the first n features are evaluated.
+	*/
+	bool evaluateFeatures(int*ls,int n,long long wpos,int wlen,double*out);
 public:
 	~featureWindow();
 	/*
@@ -190,6 +308,22 @@ public:
 		Extracts features based on a parsed window.
 	*/
 	double*extractFeatures(char*wseq,long long wpos,int wlen,bool doRead);
+	/*
+	extractFeaturesBatch
+		Extracts features for n windows into the row-major matrix out,
+		with one row of getNFeatures() values per window. Consecutive
+		overlapping windows are updated incrementally.
+	*/
+	bool extractFeaturesBatch(char**wseqs,long long*wpos,int*wlens,int n,double*out);
+	/*
+	extractFeaturesSparse
+		Extracts features based on a parsed window, and returns the number
+		of non-zero features, or -1 on failure. out is set to the non-zero
+		features, with 0-based indices, terminated by index -1.
+		Only features of motifs that occur in the window, and features
+		that do not depend on occurrences, are evaluated.
+	*/
+	int extractFeaturesSparse(char*wseq,long long wpos,int wlen,svm_node*&out);
 };
 
 
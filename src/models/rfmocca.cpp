@@ -70,8 +70,8 @@ RFMotifOccClassifier*RFMotifOccClassifier::create(int mi,motifList*ml){
 	return r.disown();
 }
 
-bool RFMotifOccClassifier::trainOcc(motifOcc*o,motifOccContainer*moc,long long wpos,char*buf,int bufs,seqClass*_cls){
-	if(!featureSet.ptr->getFeatures(features.ptr,o,moc,wpos,buf,bufs)){
+bool RFMotifOccClassifier::trainOcc(motifOcc*o,motifOccContainer*moc,compositionIndex*comp,long long wpos,char*buf,int bufs,seqClass*_cls){
+	if(!featureSet.ptr->getFeatures(features.ptr,o,moc,comp,wpos,buf,bufs)){
 		return false;
 	}
 	if(!classifier.ptr->addTrain(features.ptr,nfeatures,_cls)){
@@ -80,16 +80,51 @@ bool RFMotifOccClassifier::trainOcc(motifOcc*o,motifOccContainer*moc,long long w
 	return true;
 }
 
-bool RFMotifOccClassifier::trainFinish(){
+bool RFMotifOccClassifier::trainFeatures(double*f,seqClass*_cls){
+	if(!classifier.ptr->addTrain(f,nfeatures,_cls)){
+		return false;
+	}
+	return true;
+}
+
+bool RFMotifOccClassifier::trainFinish(bool keepExamples){
+	classifier.ptr->keepTrainingExamples=keepExamples;
 	if(!classifier.ptr->train())return false;
 	return true;
 }
 
-double RFMotifOccClassifier::applyOcc(motifOcc*o,motifOccContainer*moc,long long wpos,char*buf,int bufs){
-	if(!featureSet.ptr->getFeatures(features,o,moc,wpos,buf,bufs)){
+int RFMotifOccClassifier::getNTrainingExamples(){
+	return classifier.ptr->getNTrainingExamples();
+}
+
+double RFMotifOccClassifier::applyOcc(motifOcc*o,motifOccContainer*moc,compositionIndex*comp,long long wpos,char*buf,int bufs){
+	double v;
+	if(featureSet.ptr->getCachedOutcome(o,wpos,bufs,v))return v;
+	if(!featureSet.ptr->getFeatures(features,o,moc,comp,wpos,buf,bufs)){
 		return false;
 	}
-	return classifier.ptr->apply(features.ptr,nfeatures);
+	v=classifier.ptr->apply(features.ptr,nfeatures);
+	featureSet.ptr->cacheOutcome(o,wpos,bufs,v);
+	return v;
+}
+
+bool RFMotifOccClassifier::applyFeaturesBatch(double*m,int n,double*out){
+	return classifier.ptr->applyBatch(m,n,nfeatures,out);
+}
+
+bool RFMotifOccClassifier::applyTrainingBatch(size_t r,int n,double*out){
+	if(!trainingBatch.resize((size_t)n*nfeatures))return false;
+	for(int y=0;y<n;y++){
+		double*row=&trainingBatch[(size_t)y*nfeatures];
+		double*v=classifier.ptr->getTrainingVector((int)(r+y),row);
+		if(v!=row)memcpy(row,v,sizeof(double)*nfeatures);
+	}
+	return applyFeaturesBatch(trainingBatch.ptr,n,out);
+}
+
+void RFMotifOccClassifier::releaseTrainingExamples(){
+	classifier.ptr->releaseTrainingExamples();
+	free(trainingBatch.disown());
 }
 
 void RFMotifOccClassifier::printInfo(){
@@ -119,6 +154,11 @@ RFMOCCA*RFMOCCA::create(motifList*motifs){
 		return 0;
 	}
 	r.ptr->moc = r.ptr->mwin.ptr->occContainer;
+	if(r.ptr->cfg->MOCCA_GC||r.ptr->cfg->MOCCA_DNT){
+		if(!r.ptr->mwin.ptr->enableCompositionIndex())
+			return 0;
+	}
+	r.ptr->comp = r.ptr->mwin.ptr->composition;
 	r.ptr->motifs = r.ptr->mwin.ptr->motifs;
 	r.ptr->classifier.ptr=logoddsClassifier::create(motifs->nmotifs);
 	if(!r.ptr->classifier.ptr){
@@ -146,49 +186,38 @@ bool RFMOCCA::trainWindow(char*buf,long long pos,int bufs,seqClass*cls){
 }
 
 bool RFMOCCA::trainFinish(){
-	for(trainingSequence*ts: trainSeq.v){
-		mwin.ptr->flush();
-		if(!mwin.ptr->readWindow(ts->seq,0,ts->length)){
-			return false;
-		}
-		for(int l=0;l<motifs->nmotifs;l++){
-			RFMotifOccClassifier*c=subcls[l];
-			motifOcc*o=moc->getFirst(l);
-			while(o){
-				if(!c->trainOcc(o,moc,0,ts->seq,ts->length,ts->cls)){
-					return false;
-				}
-				o=moc->getNextSame(o);
+	int nm=motifs->nmotifs;
+	// Extract features one sequence at a time.
+	MOCCAExtractFn extract=[this,nm](int iFirst,int n,std::vector<std::vector<double>>&out) -> bool {
+		out.resize((size_t)n*nm);
+		for(int s=0;s<n;s++){
+			trainingSequence*ts=trainSeq[iFirst+s];
+			mwin.ptr->flush();
+			if(!mwin.ptr->readWindow(ts->seq,0,ts->length)){
+				return false;
 			}
-		}
-	}
-	for(RFMotifOccClassifier*sc: subcls.v){
-		if(!sc->trainFinish())return false;
-	}
-	for(trainingSequence*ts: trainSeq.v){
-		mwin.ptr->flush();
-		if(!mwin.ptr->readWindow(ts->seq,0,ts->length)){
-			return false;
-		}
-		for(int x=0;x<motifs->nmotifs;x++){
-			RFMotifOccClassifier*c=subcls[x];
-			motifOcc*o=moc->getFirst(x);
-			int nc=0;
-			while(o){
-				if( c->applyOcc(o,moc,0,ts->seq,ts->length)>0 ){
-					nc++;
+			for(int x=0;x<nm;x++){
+				RFMotifOccClassifier*c=subcls[x];
+				int nf=c->getNFeatures();
+				std::vector<double>&m=out[(size_t)s*nm+x];
+				m.clear();
+				for(motifOcc*o=moc->getFirst(x);o;o=moc->getNextSame(o)){
+					size_t r=m.size();
+					m.resize(r+nf);
+					if(!c->getFeatureSet()->getFeatures(&m[r],o,moc,comp,0,ts->seq,ts->length)){
+						return false;
+					}
 				}
-				o=moc->getNextSame(o);
 			}
-			fvec[x]=double(nc*1000)/double(ts->length);
 		}
-		if(!classifier.ptr->addTrain(fvec.ptr,nFeatures,ts->cls)){
-			return false;
-		}
-	}
-	if(!classifier.ptr->train()){
+		mwin.ptr->flush();
+		return true;
+	};
+	if(!trainMOCCAClassifiers(subcls.v,trainSeq.v,1,extract,classifier.ptr,fvec.ptr,cfg->nThreads)){
 		return false;
 	}
+	// The training sequence clones are no longer needed.
+	trainSeq.clear();
 	return true;
 }
 
@@ -201,7 +230,7 @@ double RFMOCCA::do_applyWindow(char*buf,long long pos,int bufs){
 		motifOcc*o=moc->getFirst(x);
 		int nc=0;
 		while(o){
-			if( c->applyOcc(o,moc,pos,buf,bufs)>0 ){
+			if( c->applyOcc(o,moc,comp,pos,buf,bufs)>0 ){
 				nc++;
 			}
 			o=moc->getNextSame(o);
@@ -251,7 +280,7 @@ vector<prediction> RFMOCCA::predictWindow(char*buf,long long pos,int bufs, coreP
 		motifOcc*o=moc->getFirst(x);
 		int nc=0;
 		while(o){
-			if( c->applyOcc(o,moc,pos,buf,bufs)>0 ){
+			if( c->applyOcc(o,moc,comp,pos,buf,bufs)>0 ){
 				nc++;
 				if(cpm != cpmNone){
 					int center = (o->start + o->start + motifs->motifs[x].len) / 2;
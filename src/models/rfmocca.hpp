@@ -17,15 +17,42 @@ private:
 	int motifInd;
 	int nfeatures;
 	autofree<double> features;
+	autofree<double> trainingBatch;		// Kept training examples, gathered for applyTrainingBatch
 	motifList*motifs;
 	autodelete<MotifClassifier_featureSet> featureSet;
 	RFMotifOccClassifier(int mi,motifList*ml);
 public:
 	~RFMotifOccClassifier(){  }
 	static RFMotifOccClassifier*create(int mi,motifList*ml);
-	bool trainOcc(motifOcc*o,motifOccContainer*moc,long long wpos,char*buf,int bufs,seqClass*_cls);
-	bool trainFinish();
-	double applyOcc(motifOcc*o,motifOccContainer*moc,long long wpos,char*buf,int bufs);
+	bool trainOcc(motifOcc*o,motifOccContainer*moc,compositionIndex*comp,long long wpos,char*buf,int bufs,seqClass*_cls);
+	/*
+	trainFeatures
+		Adds a training example from a precomputed occurrence feature vector.
+	*/
+	bool trainFeatures(double*f,seqClass*_cls);
+	/*
+	trainFinish
+		Trains the classifier. If keepExamples is set, the training examples
+		are kept for applyTrainingBatch until releaseTrainingExamples.
+	*/
+	bool trainFinish(bool keepExamples=false);
+	int getNTrainingExamples();
+	double applyOcc(motifOcc*o,motifOccContainer*moc,compositionIndex*comp,long long wpos,char*buf,int bufs);
+	MotifClassifier_featureSet*getFeatureSet(){ return featureSet.ptr; }
+	int getNFeatures(){ return nfeatures; }
+	/*
+	applyFeaturesBatch
+		Applies the classifier to n precomputed occurrence feature vectors
+		in the row-major matrix m, and stores the scores in out.
+	*/
+	bool applyFeaturesBatch(double*m,int n,double*out);
+	/*
+	applyTrainingBatch
+		Applies the classifier to the n kept training examples from r, and
+		stores the scores in out.
+	*/
+	bool applyTrainingBatch(size_t r,int n,double*out);
+	void releaseTrainingExamples();
 	void printInfo();
 	bool exportAnalysisData(FILE*f);
 };
@@ -38,6 +65,7 @@ private:
 	deletevector<RFMotifOccClassifier> subcls;
 	autodelete<motifWindow> mwin;
 	motifOccContainer*moc;
+	compositionIndex*comp;
 	motifList*motifs;
 	RFMOCCA(int nf);
 	//
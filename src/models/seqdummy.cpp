@@ -75,6 +75,19 @@ double SEQDummy::do_applyWindow(char*buf,long long pos,int bufs){
 	return sum;
 }
 
+bool SEQDummy::do_applyWindowBatch(windowBatch*wb){
+	double*m=wb->getFeatureMatrix(nFeatures);
+	if(!m)return false;
+	if(!fwin.ptr->extractFeaturesBatch(wb->bufs,wb->pos,wb->lens,wb->n,m))return false;
+	for(int x=0;x<wb->n;x++,m+=nFeatures){
+		double sum = 0.;
+		for(int l=0; l<nFeatures; l++)
+			sum += m[l];
+		wb->scores[x]=sum;
+	}
+	return true;
+}
+
 bool SEQDummy::printInfo(){
 	cout << t_indent << "SEQDummy classifier\n";
 	return true;
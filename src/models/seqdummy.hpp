@@ -25,6 +25,7 @@ public:
 	bool trainFinish();
 	bool flush();
 	double do_applyWindow(char*buf,long long pos,int bufs);
+	bool do_applyWindowBatch(windowBatch*wb);
 	bool printInfo();
 	bool exportAnalysisData(string path);
 };
@@ -63,6 +63,13 @@ SEQLO*SEQLO::create(motifList*motifs,featureSet*fs){
 }
 
 bool SEQLO::trainWindow(char*buf,long long pos,int bufs,seqClass*cls){
+	if(cfg->sparseFeatures){
+		svm_node*svec;
+		int nnz=fwin.ptr->extractFeaturesSparse(buf,pos,bufs,svec);
+		if(nnz<0)return false;
+		classifier.ptr->addTrainSparse(svec,nnz,nFeatures,cls);
+		return true;
+	}
 	double*fvec=fwin.ptr->extractFeatures(buf,pos,bufs,true);
 	if(!fvec)return false;
 	classifier.ptr->addTrain(fvec,nFeatures,cls);
@@ -79,11 +86,32 @@ bool SEQLO::flush(){
 }
 
 double SEQLO::do_applyWindow(char*buf,long long pos,int bufs){
+	if(cfg->sparseFeatures){
+		svm_node*svec;
+		if(fwin.ptr->extractFeaturesSparse(buf,pos,bufs,svec)<0)return -1;
+		return classifier.ptr->applySparse(svec,nFeatures);
+	}
 	double*fvec=fwin.ptr->extractFeatures(buf,pos,bufs,true);
 	if(!fvec)return -1;
 	return classifier.ptr->apply(fvec,nFeatures);
 }
 
+bool SEQLO::do_applyWindowBatch(windowBatch*wb){
+	if(cfg->sparseFeatures)return sequenceClassifier::do_applyWindowBatch(wb);
+	double*m=wb->getFeatureMatrix(nFeatures);
+	if(!m)return false;
+	if(!fwin.ptr->extractFeaturesBatch(wb->bufs,wb->pos,wb->lens,wb->n,m))return false;
+	return classifier.ptr->applyBatch(m,wb->n,nFeatures,wb->scores);
+}
+
+baseClassifier*SEQLO::getFeatureClassifier(){
+	return classifier.ptr;
+}
+
+std::vector<std::string> SEQLO::getFeatureNames(){
+	return features->getInstFeatureNames(motifs);
+}
+
 bool SEQLO::printInfo(){
 	cout << t_indent << "SEQLO classifier\n";
 	classifier.ptr->printInfo((char*)"Log-odds");
@@ -84,6 +84,21 @@ double SEQRF::do_applyWindow(char*buf,long long pos,int bufs){
 	return classifier.ptr->apply(fvec,nFeatures);
 }
 
+bool SEQRF::do_applyWindowBatch(windowBatch*wb){
+	double*m=wb->getFeatureMatrix(nFeatures);
+	if(!m)return false;
+	if(!fwin.ptr->extractFeaturesBatch(wb->bufs,wb->pos,wb->lens,wb->n,m))return false;
+	return classifier.ptr->applyBatch(m,wb->n,nFeatures,wb->scores);
+}
+
+baseClassifier*SEQRF::getFeatureClassifier(){
+	return classifier.ptr;
+}
+
+std::vector<std::string> SEQRF::getFeatureNames(){
+	return features->getInstFeatureNames(motifs);
+}
+
 bool SEQRF::printInfo(){
 	cout << t_indent << "SEQRF classifier\n";
 	classifier.ptr->printInfo((char*)"Random Forest");
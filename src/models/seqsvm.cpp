@@ -64,6 +64,13 @@ SEQSVM*SEQSVM::create(motifList*motifs,featureSet*fs,int _svmtype){
 }
 
 bool SEQSVM::trainWindow(char*buf,long long pos,int bufs,seqClass*cls){
+	if(cfg->sparseFeatures){
+		svm_node*svec;
+		int nnz=fwin.ptr->extractFeaturesSparse(buf,pos,bufs,svec);
+		if(nnz<0)return false;
+		classifier.ptr->addTrainSparse(svec,nnz,nFeatures,cls);
+		return true;
+	}
 	double*fvec=fwin.ptr->extractFeatures(buf,pos,bufs,true);
 	if(!fvec)return false;
 	classifier.ptr->addTrain(fvec,nFeatures,cls);
@@ -80,11 +87,32 @@ bool SEQSVM::flush(){
 }
 
 double SEQSVM::do_applyWindow(char*buf,long long pos,int bufs){
+	if(cfg->sparseFeatures){
+		svm_node*svec;
+		if(fwin.ptr->extractFeaturesSparse(buf,pos,bufs,svec)<0)return -1;
+		return classifier.ptr->applySparse(svec,nFeatures);
+	}
 	double*fvec=fwin.ptr->extractFeatures(buf,pos,bufs,true);
 	if(!fvec)return -1;
 	return classifier.ptr->apply(fvec,nFeatures);
 }
 
+bool SEQSVM::do_applyWindowBatch(windowBatch*wb){
+	if(cfg->sparseFeatures)return sequenceClassifier::do_applyWindowBatch(wb);
+	double*m=wb->getFeatureMatrix(nFeatures);
+	if(!m)return false;
+	if(!fwin.ptr->extractFeaturesBatch(wb->bufs,wb->pos,wb->lens,wb->n,m))return false;
+	return classifier.ptr->applyBatch(m,wb->n,nFeatures,wb->scores);
+}
+
+baseClassifier*SEQSVM::getFeatureClassifier(){
+	return classifier.ptr;
+}
+
+std::vector<std::string> SEQSVM::getFeatureNames(){
+	return features->getInstFeatureNames(motifs);
+}
+
 bool SEQSVM::printInfo(){
 	cout << t_indent << "SEQSVM classifier\n";
 	classifier.ptr->printInfo((char*)"SVM");
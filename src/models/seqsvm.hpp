@@ -27,6 +27,9 @@ public:
 	bool trainFinish();
 	bool flush();
 	double do_applyWindow(char*buf,long long pos,int bufs);
+	bool do_applyWindowBatch(windowBatch*wb);
+	baseClassifier*getFeatureClassifier();
+	std::vector<std::string> getFeatureNames();
 	bool printInfo();
 	bool exportAnalysisData(string path);
 };
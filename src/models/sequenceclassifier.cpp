@@ -16,6 +16,62 @@
 #include "baseclassifier.hpp"
 #include "sequenceclassifier.hpp"
 
+////////////////////////////////////////////////////////////////////////////////////
+// Window batches
+
+windowBatch::windowBatch(){
+	n=0;
+	nmax=0;
+	wsize=0;
+	nfeatures=0;
+}
+
+windowBatch*windowBatch::create(int _nmax,int _wsize){
+	if(_nmax<=0||_wsize<=0){
+		cmdError("Invalid window batch size.");
+		return 0;
+	}
+	autodelete<windowBatch> r(new windowBatch());
+	if(!r.ptr){
+		outOfMemory();
+		return 0;
+	}
+	r.ptr->nmax=_nmax;
+	r.ptr->wsize=_wsize;
+	r.ptr->seq.ptr=(char*)malloc(sizeof(char)*(size_t)_nmax*_wsize);
+	r.ptr->bufs.ptr=(char**)malloc(sizeof(char*)*_nmax);
+	r.ptr->pos.ptr=(long long*)malloc(sizeof(long long)*_nmax);
+	r.ptr->lens.ptr=(int*)malloc(sizeof(int)*_nmax);
+	r.ptr->scores.ptr=(double*)malloc(sizeof(double)*_nmax);
+	if(!r.ptr->seq.ptr||!r.ptr->bufs.ptr||!r.ptr->pos.ptr||!r.ptr->lens.ptr||!r.ptr->scores.ptr){
+		outOfMemory();
+		return 0;
+	}
+	for(int i=0;i<_nmax;i++)
+		r.ptr->bufs[i]=r.ptr->seq.ptr+(size_t)i*_wsize;
+	return r.disown();
+}
+
+void windowBatch::add(char*buf,long long p,int len){
+	if(n>=nmax)return;
+	if(len>wsize)len=wsize;
+	memcpy(bufs[n],buf,sizeof(char)*len);
+	pos[n]=p;
+	lens[n]=len;
+	n++;
+}
+
+double*windowBatch::getFeatureMatrix(int nf){
+	if(nf!=nfeatures||!features.ptr){
+		if(!features.resize((size_t)nmax*nf)){
+			nfeatures=0;
+			return 0;
+		}
+		nfeatures=nf;
+	}
+	return features.ptr;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////
 // Sequence classifiers
 //	These classifiers classify sequences.
@@ -38,6 +94,21 @@ bool sequenceClassifier::train(seqList*sl){
 	}
 	cmdTask task((char*)"Training");
 	cmdTask::refresh();
+	if(cfg->featuresImportPath.length()){
+		if(sl->nseq){
+			cmdTask::wipe();
+			cout << t_indent << "Using imported features. Training sequences are not scanned.\n";
+			cmdTask::refresh();
+		}
+		if(!importTrainingFeatures(cfg->featuresImportPath)){
+			return false;
+		}
+		if(!trainFinish()){
+			return false;
+		}
+		trained=true;
+		return true;
+	}
 	seqListSeq*sls=sl->seq;
 	for(int l=0;l<sl->nseq;l++,sls++){
 		if(!flush()){
@@ -64,6 +135,11 @@ bool sequenceClassifier::train(seqList*sl){
 			}
 		}
 	}
+	if(cfg->featuresExportPath.length()){
+		if(!exportTrainingFeatures(cfg->featuresExportPath)){
+			return false;
+		}
+	}
 	if(!trainFinish()){
 		return false;
 	}
@@ -71,6 +147,79 @@ bool sequenceClassifier::train(seqList*sl){
 	return true;
 }
 
+uint64_t sequenceClassifier::getFeatureHash(){
+	std::vector<std::string> names=getFeatureNames();
+	std::vector<long long> settings={
+		cfg->windowSize,
+		cfg->windowStepTrain,
+		(long long)cfg->distanceMode,
+		cfg->motifPairsCanOverlap,
+		cfg->allowHomoPairing,
+		cfg->allowHeteroPairing,
+	};
+	return featureMatrix::getHash(names,settings);
+}
+
+bool sequenceClassifier::exportTrainingFeatures(std::string path){
+	baseClassifier*bc=getFeatureClassifier();
+	if(!bc){
+		cmdError("Feature export is not supported for the classifier.");
+		return false;
+	}
+	std::vector<std::string> names=getFeatureNames();
+	if(!featureMatrix::save(path,getFeatureHash(),names,bc)){
+		return false;
+	}
+	cmdTask::wipe();
+	cout << t_indent << "Exported " << bc->getNTrainingExamples() << " training feature vectors to \"" << path << "\"\n";
+	cmdTask::refresh();
+	return true;
+}
+
+bool sequenceClassifier::importTrainingFeatures(std::string path){
+	baseClassifier*bc=getFeatureClassifier();
+	if(!bc){
+		cmdError("Feature import is not supported for the classifier.");
+		return false;
+	}
+	autodelete<featureMatrix> fm(featureMatrix::load(path));
+	if(!fm.ptr){
+		return false;
+	}
+	if(fm.ptr->getNCols()!=nFeatures||fm.ptr->header->hash!=getFeatureHash()){
+		cmdError("Imported features do not match the feature set and settings.");
+		cout << t_indent << "Path: " << path << "\n";
+		return false;
+	}
+	int nrows=fm.ptr->getNRows();
+	// Sparse examples are converted row by row. Dense rows are used in
+	// the file where the classifier allows it.
+	if(cfg->sparseFeatures){
+		autofree<svm_node> svec((size_t)nFeatures+1);
+		if(!svec.ptr){
+			outOfMemory();
+			return false;
+		}
+		for(int r=0;r<nrows;r++){
+			double*v=fm.ptr->getRow(r);
+			int nnz=0;
+			for(int i=0;i<nFeatures;i++){
+				if(v[i]==0)continue;
+				svec[nnz].index=i;
+				svec[nnz].value=v[i];
+				nnz++;
+			}
+			if(!bc->addTrainSparse(svec.ptr,nnz,nFeatures,fm.ptr->classes[fm.ptr->labels[r]]))return false;
+		}
+	}else if(!bc->addTrainMatrix(fm.disown())){
+		return false;
+	}
+	cmdTask::wipe();
+	cout << t_indent << "Imported " << nrows << " training feature vectors from \"" << path << "\"\n";
+	cmdTask::refresh();
+	return true;
+}
+
 double sequenceClassifier::getSequenceScore(seqListSeq*sls){
 	if(!flush()){
 		return -1.0;
@@ -81,12 +230,29 @@ double sequenceClassifier::getSequenceScore(seqListSeq*sls){
 	if(!createBufferWindow(sls->buf,sls->bufs,ssb.ptr,ssw.ptr,cfg->windowSize,cfg->windowStep)){
 		return -1.0;
 	}
+	autodelete<windowBatch> wb(windowBatch::create(sequenceClassifierBatchSize,cfg->windowSize));
+	if(!wb.ptr){
+		return -1.0;
+	}
 	char*rb;
 	int rbn;
 	double maxScore=0;
-	for(long i=0;(rbn=ssw.ptr->get(rb));i+=cfg->windowStep){
-		double v=applyWindow(rb,i,rbn);
-		if(!i||v>maxScore)maxScore=v;
+	bool first=true;
+	for(long i=0;;i+=cfg->windowStep){
+		rbn=ssw.ptr->get(rb);
+		if(rbn)wb.ptr->add(rb,i,rbn);
+		if(wb.ptr->n&&(!rbn||wb.ptr->full())){
+			if(!applyWindowBatch(wb.ptr)){
+				return -1.0;
+			}
+			for(int x=0;x<wb.ptr->n;x++){
+				double v=wb.ptr->scores[x];
+				if(first||v>maxScore)maxScore=v;
+				first=false;
+			}
+			wb.ptr->clear();
+		}
+		if(!rbn)break;
 	}
 	return maxScore;
 }
@@ -138,6 +304,24 @@ double sequenceClassifier::applyWindow(char*buf,long long pos,int bufs){
 	return r-threshold;
 }
 
+bool sequenceClassifier::applyWindowBatch(windowBatch*wb){
+	if(!trained){
+		cmdWarning("Tried to apply untrained classifier.");
+		return false;
+	}
+	if(!do_applyWindowBatch(wb)){
+		return false;
+	}
+	for(int x=0;x<wb->n;x++)wb->scores[x]-=threshold;
+	return true;
+}
+
+bool sequenceClassifier::do_applyWindowBatch(windowBatch*wb){
+	for(int x=0;x<wb->n;x++)
+		wb->scores[x]=do_applyWindow(wb->bufs[x],wb->pos[x],wb->lens[x]);
+	return true;
+}
+
 bool sequenceClassifier::applyFASTA(std::string inpath, std::string outpath){
 	FILE*fout=0;
 	if(!inpath.length() || !outpath.length())return false;
@@ -170,19 +354,39 @@ bool sequenceClassifier::applyFASTA(std::string inpath, std::string outpath){
 			return false;
 		}
 		fprintf(fout,"fixedStep start=1 step=%d span=%d chrom=%s\n",cfg->windowStep,cfg->windowSize,ssfbblk->getName());
-		// Apply in windows.
+		// Apply in batches of windows.
+		autodelete<windowBatch> wb(windowBatch::create(sequenceClassifierBatchSize,cfg->windowSize));
+		if(!wb.ptr){
+			fclose(fout);
+			delete ssw;
+			delete ssfb;
+			return false;
+		}
 		char*rb;
 		int rbn;
 		long nextSi=0;
-		double cvalue;
 		flush();
-		for(long i=0;(rbn=ssw->get(rb));i+=cfg->windowStep){
-			if(i>=nextSi){
-				nextSi+=50000;
-				task.setPercent((double(i)/double(bptotal))*100.0);
+		for(long i=0;;i+=cfg->windowStep){
+			rbn=ssw->get(rb);
+			if(rbn){
+				if(i>=nextSi){
+					nextSi+=50000;
+					task.setPercent((double(i)/double(bptotal))*100.0);
+				}
+				wb.ptr->add(rb,i,rbn);
 			}
-			cvalue=applyWindow(rb,i,rbn);
-			fprintf(fout,"%lf\n",cvalue+threshold);
+			if(wb.ptr->n&&(!rbn||wb.ptr->full())){
+				if(!applyWindowBatch(wb.ptr)){
+					fclose(fout);
+					delete ssw;
+					delete ssfb;
+					return false;
+				}
+				for(int x=0;x<wb.ptr->n;x++)
+					fprintf(fout,"%lf\n",wb.ptr->scores[x]+threshold);
+				wb.ptr->clear();
+			}
+			if(!rbn)break;
 		}
 		delete ssw;
 	}
@@ -233,7 +437,14 @@ bool sequenceClassifier::predictGenomewideFASTA(std::string inFASTAPath, std::st
 			delete ssfb;
 			return false;
 		}
-		// Apply in windows.
+		// Apply in batches of windows.
+		autodelete<windowBatch> wb(windowBatch::create(sequenceClassifierBatchSize,cfg->windowSize));
+		if(!wb.ptr){
+			delete ssw;
+			delete ssfb;
+			return false;
+		}
+		vector<vector<prediction>> wpreds;
 		char*rb;
 		int rbn;
 		long nextSi=0;
@@ -242,36 +453,52 @@ bool sequenceClassifier::predictGenomewideFASTA(std::string inFASTAPath, std::st
 		vector<prediction> pred;
 		flush();
 		int lastPredWndEnd = -1;
-		for(long i=0;(rbn=ssw->get(rb));i+=cfg->windowStep){
-			cit += rbn - (cfg->windowSize-cfg->windowStep);
-			if(cit>=nextSi){
-				nextSi+=50000;
-				task.setPercent((double(cit)/double(bptotal))*100.0);
+		for(long i=0;;i+=cfg->windowStep){
+			rbn=ssw->get(rb);
+			if(rbn){
+				cit += rbn - (cfg->windowSize-cfg->windowStep);
+				if(cit>=nextSi){
+					nextSi+=50000;
+					task.setPercent((double(cit)/double(bptotal))*100.0);
+				}
+				wb.ptr->add(rb,i,rbn);
 			}
-			vector<prediction> wpred = predictWindow(rb, i, rbn, cfg->corePredictionMode);
-			cvalue = wpred.size() > 0 ? wpred.back().score : -9999999999.;
-			if(ofWig.is_open())
-				ofWig << (cvalue) << "\n";
-			if(cvalue >= threshold){
-				if(cfg->corePredictionMax){
-					// For maximum core prediction mode, find the maximally scoring
-					// core prediction, and add/replace last depending on whether
-					// the last predicted window is non-overlapping or overlapping,
-					// respectively.
-					prediction pmax = prediction(-1, -1, -999999999.);
-					if(lastPredWndEnd >= i) pmax = pred.back();
-					for(auto&p: wpred)
-						if(p.score > pmax.score)
-							pmax = p;
-					if(lastPredWndEnd >= i) pred.back() = pmax;
-					else pred.push_back(pmax);
-				}else{
-					// For the normal mode, just add all.
-					for(auto&p: wpred)
-						pred.push_back(p);
+			if(wb.ptr->n&&(!rbn||wb.ptr->full())){
+				if(!predictWindowBatch(wb.ptr,cfg->corePredictionMode,wpreds)){
+					delete ssw;
+					delete ssfb;
+					return false;
+				}
+				for(int x=0;x<wb.ptr->n;x++){
+					long long wpos = wb.ptr->pos[x];
+					vector<prediction>&wpred = wpreds[x];
+					cvalue = wpred.size() > 0 ? wpred.back().score : -9999999999.;
+					if(ofWig.is_open())
+						ofWig << (cvalue) << "\n";
+					if(cvalue >= threshold){
+						if(cfg->corePredictionMax){
+							// For maximum core prediction mode, find the maximally scoring
+							// core prediction, and add/replace last depending on whether
+							// the last predicted window is non-overlapping or overlapping,
+							// respectively.
+							prediction pmax = prediction(-1, -1, -999999999.);
+							if(lastPredWndEnd >= wpos) pmax = pred.back();
+							for(auto&p: wpred)
+								if(p.score > pmax.score)
+									pmax = p;
+							if(lastPredWndEnd >= wpos) pred.back() = pmax;
+							else pred.push_back(pmax);
+						}else{
+							// For the normal mode, just add all.
+							for(auto&p: wpred)
+								pred.push_back(p);
+						}
+						lastPredWndEnd = wpos + wb.ptr->lens[x];
+					}
 				}
-				lastPredWndEnd = i + rbn;
+				wb.ptr->clear();
 			}
+			if(!rbn)break;
 		}
 		if(pEnd != -1){
 			cmdTask::wipe();
@@ -371,6 +598,13 @@ vector<prediction> sequenceClassifier::predictWindow(char*buf,long long pos,int
 	return ret;
 }
 
+bool sequenceClassifier::predictWindowBatch(windowBatch*wb,corePredictionModeT cpm,vector<vector<prediction>>&out){
+	out.resize(wb->n);
+	for(int x=0;x<wb->n;x++)
+		out[x]=predictWindow(wb->bufs[x],wb->pos[x],wb->lens[x],cpm);
+	return true;
+}
+
 bool sequenceClassifier::calibrateThresholdGenomewidePrecision(seqList*calpos,double wantPrecision){
 	threshold=0.;
 	int nvp=0;
@@ -21,11 +21,76 @@ struct prediction{
 	}
 };
 
+////////////////////////////////////////////////////////////////////////////////////
+// Window batches
+
+/*
+sequenceClassifierBatchSize
+	Number of windows gathered before they are classified together.
+*/
+#define sequenceClassifierBatchSize 256
+
+/*
+windowBatch
+	Holds copies of consecutive windows, for batched classification.
+	Windows are copied, since stream window buffers are only valid
+	until the next window is read.
+*/
+class windowBatch{
+private:
+	// Private constructor
+	windowBatch();
+public:
+	int n;						// Number of windows
+	int nmax;					// Capacity
+	int wsize;					// Maximal window size
+	autofree<char> seq;			// Window sequence storage
+	autofree<char*> bufs;		// Window sequences
+	autofree<long long> pos;	// Window positions
+	autofree<int> lens;			// Window lengths
+	autofree<double> scores;	// Window scores
+	autofree<double> features;	// Row-major feature matrix
+	int nfeatures;				// Number of features per row in the feature matrix
+	/*
+	create
+		Call to construct
+	*/
+	static windowBatch*create(int _nmax,int _wsize);
+	/*
+	add
+		Adds a copy of a window.
+	*/
+	void add(char*buf,long long p,int len);
+	/*
+	getFeatureMatrix
+		Returns the feature matrix, with room for nf features per window.
+	*/
+	double*getFeatureMatrix(int nf);
+	inline bool full(){ return n>=nmax; }
+	inline void clear(){ n=0; }
+};
+
 ////////////////////////////////////////////////////////////////////////////////////
 // Sequence classifiers
 
 class sequenceClassifier{
 private:
+	/*
+	getFeatureHash
+		Returns the hash identifying the window features and the settings
+		they depend on, for feature matrix files.
+	*/
+	uint64_t getFeatureHash();
+	/*
+	exportTrainingFeatures
+		Saves the training feature vectors as a feature matrix file.
+	*/
+	bool exportTrainingFeatures(std::string path);
+	/*
+	importTrainingFeatures
+		Adds training feature vectors from a feature matrix file.
+	*/
+	bool importTrainingFeatures(std::string path);
 public:
 	config*cfg;
 	int nFeatures;
@@ -37,6 +102,12 @@ public:
 	double getSequenceScore(seqListSeq*sls);
 	bool getValidationTable(seqList*sl,validationPair*&vp,int&nvp);
 	double applyWindow(char*buf,long long pos,int bufs);
+	/*
+	applyWindowBatch
+		Applies the classifier to all windows in the batch, and stores
+		the scores in the batch.
+	*/
+	bool applyWindowBatch(windowBatch*wb);
 	//
 	/*
 	applyFASTA
@@ -58,10 +129,32 @@ public:
 	virtual bool trainWindow(char*buf,long long pos,int bufs,seqClass*cls) = 0;
 	virtual bool trainFinish() = 0;
 	virtual double do_applyWindow(char*buf,long long pos,int bufs) = 0;
+	/*
+	do_applyWindowBatch
+		Batched do_applyWindow. By default, applies window by window.
+	*/
+	virtual bool do_applyWindowBatch(windowBatch*wb);
 	virtual bool flush() = 0;
 	virtual bool printInfo() = 0;
 	virtual bool exportAnalysisData(string path) = 0;
 	virtual vector<prediction> predictWindow(char*buf,long long pos,int bufs, corePredictionModeT cpm);
+	/*
+	predictWindowBatch
+		Batched predictWindow. Sets out to the predictions for each window
+		in the batch. By default, predicts window by window.
+	*/
+	virtual bool predictWindowBatch(windowBatch*wb,corePredictionModeT cpm,vector<vector<prediction>>&out);
+	/*
+	getFeatureClassifier
+		Returns the base classifier trained on window feature vectors, or
+		0 if there is none. Used for feature matrix export and import.
+	*/
+	virtual baseClassifier*getFeatureClassifier(){ return 0; }
+	/*
+	getFeatureNames
+		Returns the names of the window features.
+	*/
+	virtual std::vector<std::string> getFeatureNames(){ return std::vector<std::string>(); }
 };
 
 ////////////////////////////////////////////////////////////////////////////////////
@@ -23,6 +23,7 @@
 MotifClassifier_featureSet::MotifClassifier_featureSet(motifList*_motifs){
 	features=0;
 	nfeatures=0;
+	reach=0;
 	motifs = _motifs;
 }
 
@@ -53,6 +54,10 @@ MotifClassifier_featureI*MotifClassifier_featureSet::addFeature(MotifClassifier_
 	r->da=da;
 	r->db=db;
 	r->f=f;
+	int maxLen=0;
+	for(int l=0;l<motifs->nmotifs;l++)
+		maxLen=max(maxLen,motifs->motifs[l].len);
+	reach=max(reach,ib+maxLen+1);
 	
 	//-------------------------
 	// Add feature name to list
@@ -89,26 +94,17 @@ bool MotifClassifier_featureSet::addFeatures(MotifClassifier_feature f,int ia,in
 	return true;
 }
 
-bool MotifClassifier_featureSet::getFeatures(double*out,motifOcc*o,motifOccContainer*moc,long long wpos,char*buf,int bufs){
+bool MotifClassifier_featureSet::getFeatures(double*out,motifOcc*o,motifOccContainer*moc,compositionIndex*comp,long long wpos,char*buf,int bufs){
 	MotifClassifier_featureI*cf=features;
+	int dnt[16];
+	int dntIb=-1;
 	for(int l=0;l<nfeatures;l++,cf++){
 		switch(cf->f){
 		case MF_nOcc:{
-			int c=0;
-			motifOcc*o2=moc->getFirst(cf->ia);
-			while(o2){
-				if(o2==o){
-					o2=moc->getNextSame(o2);
-					continue;
-				}
-				double d_gamma=(double(o2->start)+double(o2->mot->len)/2.0)
-									-(double(o->start)+double(o->mot->len)/2.0);
-				if(d_gamma<0)d_gamma=-d_gamma;
-				if(d_gamma<cf->ib){
-					c++;
-				}
-				o2=moc->getNextSame(o2);
-			}
+			// Occurrences of motif ia with centers within ib, not counting o itself
+			int c=moc->countCentersWithin(cf->ia,o->start*2+o->mot->len,cf->ib);
+			if(c<0)return false;
+			if(o->mot->index==cf->ia&&cf->ib>0)c--;
 			out[l]=double(c);
 			break;}
 		case MF_GC:{
@@ -116,75 +112,21 @@ bool MotifClassifier_featureSet::getFeatures(double*out,motifOcc*o,motifOccConta
 			int iA=max(iS-cf->ib,0);
 			int iB=min(iS+cf->ib+1,bufs);
 			int nl=iB-iA;
-
-			int nGC=0;
-			char c;
-			char*b=&buf[iA];
-			for(int x=iA;x<iB;x++,b++){
-				c=*b;
-				if(c=='G'||c=='C')nGC++;
-			}
-			out[l]=nl>0?double(nGC)/double(nl):0;
+			out[l]=nl>0?double(comp->getGC(wpos+iA,wpos+iB))/double(nl):0;
 			break;}
 		case MF_DNT:{
-			if(o->extra_buffer){
-				int oC=int(o->start+int(double(o->mot->len)/2.0)-wpos);
-				int iA=min(max(oC-cf->ib,0),bufs);
-				int iB=min(max(oC+cf->ib+1,0),bufs);
-				int nl=(iB-1)-iA;
-				double*tbl=(double*)o->extra_buffer;
-				int*tbls=(int*)&tbl[16];
-				if(*tbls!=nl){
-					free(o->extra_buffer);
-					o->extra_buffer=0;
-				}
-			}
-			if(!o->extra_buffer){
-				double*tbl=(double*)malloc(sizeof(double)*4*4+sizeof(int));
-				if(!tbl){
-					outOfMemory();
-					return false;
-				}
-				memset(tbl,0,sizeof(double)*4*4+sizeof(int));
-				o->extra_buffer=tbl;
-				int*tbls=(int*)&tbl[16];
-				// Get DNT
-				int oC=int(o->start+int(double(o->mot->len)/2.0)-wpos);
-				int iA=min(max(oC-cf->ib,0),bufs);
-				int iB=min(max(oC+cf->ib+1,0),bufs);
-				int nl=(iB-1)-iA;
-				*tbls=nl;
-				//
-				char nti[256] = {0};
-				memset(nti,-1,256);
-				nti['A'] = 0;
-				nti['T'] = 1;
-				nti['G'] = 2;
-				nti['C'] = 3;
-				//
-				int cnti = buf[iA] << 2, cntiRC, ci;
-				char*c=&buf[iA];
-				int nValid = 0;
-				for(int x = iA; x<iB; x++, c++){
-					ci = nti[int(*c)];
-					if(ci == -1){
-						nValid = 0;
-						continue;
-					}
-					cnti = ( (cnti<<2) | ci ) & 15;
-					nValid++;
-					if(nValid<=1)continue;
-					tbl[cnti] += 1.0;
-					cntiRC = ( (cnti>>2) | ((cnti&3)<<2) ) ^ 5;
-					tbl[cntiRC] += 1.0;
-				}
-				//
-				if(nl>0)
-					for(int x=0;x<16;x++)
-						tbl[x]/=double(nl);
+			int oC=int(o->start+int(double(o->mot->len)/2.0)-wpos);
+			int iA=min(max(oC-cf->ib,0),bufs);
+			int iB=min(max(oC+cf->ib+1,0),bufs);
+			int nl=(iB-1)-iA;
+			if(dntIb!=cf->ib){
+				comp->getDNT(wpos+iA,wpos+iB,dnt);
+				dntIb=cf->ib;
 			}
-			double*tbl=(double*)o->extra_buffer;
-			out[l]=tbl[cf->ia];
+			// Count in both orientations
+			int cRC=( (cf->ia>>2) | ((cf->ia&3)<<2) ) ^ 5;
+			double v=double(dnt[cf->ia]+dnt[cRC]);
+			out[l]=nl>0?v/double(nl):v;
 			break;}
 		default:
 			cmdWarning("Invalid feature");
@@ -193,11 +135,34 @@ bool MotifClassifier_featureSet::getFeatures(double*out,motifOcc*o,motifOccConta
 	return true;
 }
 
+bool MotifClassifier_featureSet::getCachedOutcome(motifOcc*o,long long wpos,int bufs,double&out){
+	if(!o->extra_buffer||!isInterior(o,wpos,bufs))return false;
+	MotifOccOutcome*c=(MotifOccOutcome*)o->extra_buffer;
+	if(c->row>=0)return false;
+	out=c->score;
+	return true;
+}
+
+bool MotifClassifier_featureSet::cacheOutcome(motifOcc*o,long long wpos,int bufs,double v){
+	if(!isInterior(o,wpos,bufs))return true;
+	if(!o->extra_buffer){
+		o->extra_buffer=malloc(sizeof(MotifOccOutcome));
+		if(!o->extra_buffer){
+			outOfMemory();
+			return false;
+		}
+	}
+	((MotifOccOutcome*)o->extra_buffer)->score=v;
+	((MotifOccOutcome*)o->extra_buffer)->row=-1;
+	return true;
+}
+
 MotifOccClassifier::MotifOccClassifier(int mi,motifList*ml){
 	cfg=getConfiguration();
 	motifInd=mi;
 	motifs=ml;
 	nfeatures=0;
+	batchCap=0;
 }
 
 MotifOccClassifier*MotifOccClassifier::create(int svmtype,int mi,motifList*ml){
@@ -242,8 +207,8 @@ MotifOccClassifier*MotifOccClassifier::create(int svmtype,int mi,motifList*ml){
 	return r.disown();
 }
 
-bool MotifOccClassifier::trainOcc(motifOcc*o,motifOccContainer*moc,long long wpos,char*buf,int bufs,seqClass*_cls){
-	if(!featureSet.ptr->getFeatures(features.ptr,o,moc,wpos,buf,bufs)){
+bool MotifOccClassifier::trainOcc(motifOcc*o,motifOccContainer*moc,compositionIndex*comp,long long wpos,char*buf,int bufs,seqClass*_cls){
+	if(!featureSet.ptr->getFeatures(features.ptr,o,moc,comp,wpos,buf,bufs)){
 		return false;
 	}
 	if(!classifier.ptr->addTrain(features.ptr,nfeatures,_cls)){
@@ -252,18 +217,160 @@ bool MotifOccClassifier::trainOcc(motifOcc*o,motifOccContainer*moc,long long wpo
 	return true;
 }
 
-bool MotifOccClassifier::trainFinish(){
+bool MotifOccClassifier::trainFeatures(double*f,seqClass*_cls){
+	if(!classifier.ptr->addTrain(f,nfeatures,_cls)){
+		return false;
+	}
+	return true;
+}
+
+bool MotifOccClassifier::trainFinish(bool keepExamples){
+	classifier.ptr->keepTrainingExamples=keepExamples;
 	if(!classifier.ptr->train())return false;
 	return true;
 }
 
-double MotifOccClassifier::applyOcc(motifOcc*o,motifOccContainer*moc,long long wpos,char*buf,int bufs){
-	if(!featureSet.ptr->getFeatures(features,o,moc,wpos,buf,bufs)){
+int MotifOccClassifier::getNTrainingExamples(){
+	return classifier.ptr->getNTrainingExamples();
+}
+
+double MotifOccClassifier::applyOcc(motifOcc*o,motifOccContainer*moc,compositionIndex*comp,long long wpos,char*buf,int bufs){
+	double v;
+	if(featureSet.ptr->getCachedOutcome(o,wpos,bufs,v))return v;
+	if(!featureSet.ptr->getFeatures(features,o,moc,comp,wpos,buf,bufs)){
 		return false;
 	}
 	seqClass*r=classifier.ptr->apply(features.ptr,nfeatures);
 	if(!r)return 0;
-	return r->flag?1.0:-1.0;
+	v=r->flag?1.0:-1.0;
+	featureSet.ptr->cacheOutcome(o,wpos,bufs,v);
+	return v;
+}
+
+int MotifOccClassifier::applyOccBatch(motifOccContainer*moc,compositionIndex*comp,long long wpos,char*buf,int bufs,motifOcc**&occs,double*&out){
+	batchOccs.clear();
+	batchOutcomes.clear();
+	batchRows.clear();
+	for(motifOcc*o=moc->getFirst(motifInd);o;o=moc->getNextSame(o)){
+		double v=0;
+		if(!featureSet.ptr->getCachedOutcome(o,wpos,bufs,v))
+			batchRows.push_back((int)batchOccs.size());
+		batchOccs.push_back(o);
+		batchOutcomes.push_back(v);
+	}
+	int n=(int)batchRows.size();
+	if(n){
+		if(n>batchCap){
+			if(!batchFeatures.resize((size_t)n*nfeatures)||!batchClasses.resize(n)){
+				batchCap=0;
+				return -1;
+			}
+			batchCap=n;
+		}
+		for(int r=0;r<n;r++){
+			if(!featureSet.ptr->getFeatures(&batchFeatures[r*nfeatures],batchOccs[batchRows[r]],moc,comp,wpos,buf,bufs)){
+				return -1;
+			}
+		}
+		if(!classifier.ptr->applyBatch(batchFeatures.ptr,n,nfeatures,batchClasses.ptr)){
+			return -1;
+		}
+		for(int r=0;r<n;r++){
+			motifOcc*o=batchOccs[batchRows[r]];
+			double v=(batchClasses[r]&&batchClasses[r]->flag)?1.0:-1.0;
+			batchOutcomes[batchRows[r]]=v;
+			if(!featureSet.ptr->cacheOutcome(o,wpos,bufs,v))return -1;
+		}
+	}
+	occs=batchOccs.data();
+	out=batchOutcomes.data();
+	return (int)batchOccs.size();
+}
+
+int MotifOccClassifier::gatherOcc(motifOcc*o,motifOccContainer*moc,compositionIndex*comp,long long wpos,char*buf,int bufs,double&v){
+	bool interior=featureSet.ptr->isInterior(o,wpos,bufs);
+	MotifOccOutcome*c=(MotifOccOutcome*)o->extra_buffer;
+	if(interior&&c){
+		if(c->row>=0)return c->row;
+		v=c->score;
+		return -1;
+	}
+	int r=int(gathered.size()/nfeatures);
+	gathered.resize(gathered.size()+nfeatures);
+	if(!featureSet.ptr->getFeatures(&gathered[(size_t)r*nfeatures],o,moc,comp,wpos,buf,bufs)){
+		return -2;
+	}
+	if(interior){
+		// Pending until classifyGathered
+		if(!featureSet.ptr->cacheOutcome(o,wpos,bufs,0))return -2;
+		((MotifOccOutcome*)o->extra_buffer)->row=r;
+	}
+	return r;
+}
+
+bool MotifOccClassifier::classifyGathered(motifOccContainer*moc){
+	int n=int(gathered.size()/nfeatures);
+	gatheredClasses.resize(n);
+	gatheredOutcomes.resize(n);
+	if(!n)return true;
+	if(!classifier.ptr->applyBatch(gathered.data(),n,nfeatures,gatheredClasses.data())){
+		return false;
+	}
+	for(int r=0;r<n;r++){
+		gatheredOutcomes[r]=(gatheredClasses[r]&&gatheredClasses[r]->flag)?1.0:-1.0;
+	}
+	for(motifOcc*o=moc->getFirst(motifInd);o;o=moc->getNextSame(o)){
+		MotifOccOutcome*c=(MotifOccOutcome*)o->extra_buffer;
+		if(c&&c->row>=0){
+			c->score=gatheredOutcomes[c->row];
+			c->row=-1;
+		}
+	}
+	return true;
+}
+
+void MotifOccClassifier::clearGathered(){
+	gathered.clear();
+	gatheredOutcomes.clear();
+}
+
+bool MotifOccClassifier::applyFeaturesBatch(double*m,int n,double*out){
+	if(!n)return true;
+	if(n>batchCap){
+		if(!batchFeatures.resize((size_t)n*nfeatures)||!batchClasses.resize(n)){
+			batchCap=0;
+			return false;
+		}
+		batchCap=n;
+	}
+	if(!classifier.ptr->applyBatch(m,n,nfeatures,batchClasses.ptr)){
+		return false;
+	}
+	for(int r=0;r<n;r++){
+		out[r]=(batchClasses[r]&&batchClasses[r]->flag)?1.0:-1.0;
+	}
+	return true;
+}
+
+bool MotifOccClassifier::applyTrainingBatch(size_t r,int n,double*out){
+	if(!n)return true;
+	if(n>batchCap){
+		if(!batchFeatures.resize((size_t)n*nfeatures)||!batchClasses.resize(n)){
+			batchCap=0;
+			return false;
+		}
+		batchCap=n;
+	}
+	for(int y=0;y<n;y++){
+		double*row=&batchFeatures[(size_t)y*nfeatures];
+		double*v=classifier.ptr->getTrainingVector((int)(r+y),row);
+		if(v!=row)memcpy(row,v,sizeof(double)*nfeatures);
+	}
+	return applyFeaturesBatch(batchFeatures.ptr,n,out);
+}
+
+void MotifOccClassifier::releaseTrainingExamples(){
+	classifier.ptr->releaseTrainingExamples();
 }
 
 void MotifOccClassifier::printInfo(){
@@ -294,6 +401,11 @@ SVMMOCCA*SVMMOCCA::create(motifList*motifs,int _svmtype){
 		return 0;
 	}
 	r.ptr->moc = r.ptr->mwin.ptr->occContainer;
+	if(r.ptr->cfg->MOCCA_GC||r.ptr->cfg->MOCCA_DNT){
+		if(!r.ptr->mwin.ptr->enableCompositionIndex())
+			return 0;
+	}
+	r.ptr->comp = r.ptr->mwin.ptr->composition;
 	r.ptr->motifs = r.ptr->mwin.ptr->motifs;
 	r.ptr->classifier.ptr=logoddsClassifier::create(motifs->nmotifs);
 	if(!r.ptr->classifier.ptr){
@@ -320,50 +432,63 @@ bool SVMMOCCA::trainWindow(char*buf,long long pos,int bufs,seqClass*cls){
 	return true;
 }
 
-bool SVMMOCCA::trainFinish(){
-	for(trainingSequence*ts: trainSeq.v){
-		mwin.ptr->flush();
-		if(!mwin.ptr->readWindow(ts->seq,0,ts->length)){
-			return false;
-		}
-		for(int l=0;l<motifs->nmotifs;l++){
-			MotifOccClassifier*c=subcls[l];
-			motifOcc*o=moc->getFirst(l);
-			while(o){
-				if(!c->trainOcc(o,moc,0,ts->seq,ts->length,ts->cls)){
+bool SVMMOCCA::extractTrainingFeatures(deletevector<motifWindow>&wins,int iFirst,int n,std::vector<std::vector<double>>&out){
+	int nm=motifs->nmotifs;
+	out.resize((size_t)n*nm);
+	for(auto&m:out)m.clear();
+	int nw=(int)wins.v.size();
+	std::vector<std::function<bool()>> tasks;
+	std::vector<size_t> costs;
+	for(int w=0;w<nw;w++){
+		motifWindow*win=wins[w];
+		tasks.push_back([this,win,w,nw,iFirst,n,nm,&out]() -> bool {
+			motifOccContainer*wmoc=win->occContainer;
+			compositionIndex*wcomp=win->composition;
+			for(int s=w;s<n;s+=nw){
+				trainingSequence*ts=trainSeq[iFirst+s];
+				win->flush();
+				if(!win->readWindow(ts->seq,0,ts->length)){
 					return false;
 				}
-				o=moc->getNextSame(o);
-			}
-		}
-	}
-	for(MotifOccClassifier*sc: subcls.v){
-		if(!sc->trainFinish())return false;
-	}
-	for(trainingSequence*ts: trainSeq.v){
-		mwin.ptr->flush();
-		if(!mwin.ptr->readWindow(ts->seq,0,ts->length)){
-			return false;
-		}
-		for(int x=0;x<motifs->nmotifs;x++){
-			MotifOccClassifier*c=subcls[x];
-			motifOcc*o=moc->getFirst(x);
-			int nc=0;
-			while(o){
-				if( c->applyOcc(o,moc,0,ts->seq,ts->length)>0 ){
-					nc++;
+				for(int x=0;x<nm;x++){
+					MotifOccClassifier*c=subcls[x];
+					int nf=c->getNFeatures();
+					std::vector<double>&m=out[(size_t)s*nm+x];
+					for(motifOcc*o=wmoc->getFirst(x);o;o=wmoc->getNextSame(o)){
+						size_t r=m.size();
+						m.resize(r+nf);
+						if(!c->getFeatureSet()->getFeatures(&m[r],o,wmoc,wcomp,0,ts->seq,ts->length)){
+							return false;
+						}
+					}
 				}
-				o=moc->getNextSame(o);
 			}
-			fvec[x]=double(nc*1000)/double(ts->length);
-		}
-		if(!classifier.ptr->addTrain(fvec.ptr,nFeatures,ts->cls)){
-			return false;
-		}
+			return true;
+		});
+		costs.push_back(1);
 	}
-	if(!classifier.ptr->train()){
+	return runParallel(tasks,costs,nw);
+}
+
+bool SVMMOCCA::trainFinish(){
+	int nseq=(int)trainSeq.v.size();
+	// One motif window per thread.
+	deletevector<motifWindow> wins;
+	int nw=std::max(1,std::min(cfg->nThreads,nseq));
+	for(int w=0;w<nw;w++){
+		motifWindow*win=motifWindow::createShared(mwin.ptr);
+		if(!win)return false;
+		wins.push_back(win);
+	}
+	// Extract features in parallel, in blocks of sequences.
+	MOCCAExtractFn extract=[this,&wins](int iFirst,int n,std::vector<std::vector<double>>&out) -> bool {
+		return extractTrainingFeatures(wins,iFirst,n,out);
+	};
+	if(!trainMOCCAClassifiers(subcls.v,trainSeq.v,nw*SVMMOCCATrainBlock,extract,classifier.ptr,fvec.ptr,cfg->nThreads)){
 		return false;
 	}
+	// The training sequence clones are no longer needed.
+	trainSeq.clear();
 	return true;
 }
 
@@ -372,20 +497,82 @@ double SVMMOCCA::do_applyWindow(char*buf,long long pos,int bufs){
 		return false;
 	}
 	for(int x=0;x<motifs->nmotifs;x++){
-		MotifOccClassifier*c=subcls[x];
-		motifOcc*o=moc->getFirst(x);
+		motifOcc**occs;
+		double*outcomes;
+		int n=subcls[x]->applyOccBatch(moc,comp,pos,buf,bufs,occs,outcomes);
+		if(n<0)return false;
 		int nc=0;
-		while(o){
-			if( c->applyOcc(o,moc,pos,buf,bufs)>0 ){
-				nc++;
-			}
-			o=moc->getNextSame(o);
+		for(int y=0;y<n;y++){
+			if(outcomes[y]>0)nc++;
 		}
 		fvec[x]=double(nc*1000)/double(bufs);
 	}
 	return classifier.ptr->apply(fvec.ptr,nFeatures);
 }
 
+bool SVMMOCCA::classifyWindowBatch(windowBatch*wb){
+	int nm=motifs->nmotifs;
+	windowOccs.clear();
+	windowOccFirst.assign(1,0);
+	for(int x=0;x<nm;x++)subcls[x]->clearGathered();
+	for(int w=0;w<wb->n;w++){
+		char*buf=wb->bufs[w];
+		long long pos=wb->pos[w];
+		int bufs=wb->lens[w];
+		if(!mwin.ptr->readWindow(buf,pos,bufs)){
+			return false;
+		}
+		for(int x=0;x<nm;x++){
+			for(motifOcc*o=moc->getFirst(x);o;o=moc->getNextSame(o)){
+				MOCCAWindowOcc e;
+				e.motif=x;
+				e.start=o->start;
+				e.outcome=0;
+				e.row=subcls[x]->gatherOcc(o,moc,comp,pos,buf,bufs,e.outcome);
+				if(e.row==-2)return false;
+				windowOccs.push_back(e);
+			}
+		}
+		windowOccFirst.push_back((int)windowOccs.size());
+	}
+	for(int x=0;x<nm;x++){
+		if(!subcls[x]->classifyGathered(moc))return false;
+	}
+	return true;
+}
+
+void SVMMOCCA::getWindowFeatures(int w,int bufs,double*out,vector<prediction>*motpos){
+	int nm=motifs->nmotifs;
+	std::vector<int> nc(nm,0);
+	for(int i=windowOccFirst[w];i<windowOccFirst[w+1];i++){
+		MOCCAWindowOcc&e=windowOccs[i];
+		double v=e.row>=0?subcls[e.motif]->getGatheredOutcome(e.row):e.outcome;
+		if(v<=0)continue;
+		nc[e.motif]++;
+		if(motpos){
+			int len=motifs->motifs[e.motif].len;
+			int center = (e.start + e.start + len) / 2;
+			double mscore = classifier.ptr->getWeight(e.motif);
+			motpos->push_back(prediction(center - 250, center + 250, mscore,
+				e.start,
+				e.start + len));
+		}
+	}
+	for(int x=0;x<nm;x++){
+		out[x]=double(nc[x]*1000)/double(bufs);
+	}
+}
+
+bool SVMMOCCA::do_applyWindowBatch(windowBatch*wb){
+	if(!classifyWindowBatch(wb))return false;
+	double*m=wb->getFeatureMatrix(nFeatures);
+	if(!m)return false;
+	for(int w=0;w<wb->n;w++){
+		getWindowFeatures(w,wb->lens[w],&m[(size_t)w*nFeatures],0);
+	}
+	return classifier.ptr->applyBatch(m,wb->n,nFeatures,wb->scores);
+}
+
 bool SVMMOCCA::flush(){
 	return mwin.ptr->flush();
 }
@@ -420,26 +607,42 @@ vector<prediction> SVMMOCCA::predictWindow(char*buf,long long pos,int bufs, core
 	if(!mwin.ptr->readWindow(buf,pos,bufs)){
 		return ret;
 	}
-	vector<prediction> motpos = vector<prediction>();
+	// A batch of one window, with outcomes from applyOccBatch
+	windowOccs.clear();
+	windowOccFirst.assign(1,0);
 	for(int x=0;x<motifs->nmotifs;x++){
-		MotifOccClassifier*c=subcls[x];
-		motifOcc*o=moc->getFirst(x);
-		int nc=0;
-		while(o){
-			if( c->applyOcc(o,moc,pos,buf,bufs)>0 ){
-				nc++;
-				if(cpm != cpmNone){
-					int center = (o->start + o->start + motifs->motifs[x].len) / 2;
-					double mscore = classifier.ptr->getWeight(x);
-					motpos.push_back(prediction(center - 250, center + 250, mscore,
-						o->start,
-						o->start + motifs->motifs[x].len));
-				}
-			}
-			o=moc->getNextSame(o);
+		motifOcc**occs;
+		double*outcomes;
+		int n=subcls[x]->applyOccBatch(moc,comp,pos,buf,bufs,occs,outcomes);
+		if(n<0)return ret;
+		for(int y=0;y<n;y++){
+			MOCCAWindowOcc e;
+			e.motif=x;
+			e.start=occs[y]->start;
+			e.row=-1;
+			e.outcome=outcomes[y];
+			windowOccs.push_back(e);
 		}
-		fvec[x]=double(nc*1000)/double(bufs);
 	}
+	windowOccFirst.push_back((int)windowOccs.size());
+	vector<prediction> motpos = vector<prediction>();
+	getWindowFeatures(0,bufs,fvec.ptr,cpm != cpmNone?&motpos:0);
+	return predictMotifs(pos,bufs,cpm,motpos);
+}
+
+bool SVMMOCCA::predictWindowBatch(windowBatch*wb,corePredictionModeT cpm,vector<vector<prediction>>&out){
+	if(!classifyWindowBatch(wb))return false;
+	out.resize(wb->n);
+	for(int w=0;w<wb->n;w++){
+		vector<prediction> motpos = vector<prediction>();
+		getWindowFeatures(w,wb->lens[w],fvec.ptr,cpm != cpmNone?&motpos:0);
+		out[w]=predictMotifs(wb->pos[w],wb->lens[w],cpm,motpos);
+	}
+	return true;
+}
+
+vector<prediction> SVMMOCCA::predictMotifs(long long pos,int bufs,corePredictionModeT cpm,vector<prediction>&motpos){
+	vector<prediction> ret = vector<prediction>();
 	double cvalue = classifier.ptr->apply(fvec.ptr,nFeatures);
 	if(cpm != cpmNone){
 		if(cvalue >= threshold){
@@ -23,6 +23,15 @@ typedef struct{
 	double da,db;
 }MotifClassifier_featureI;
 
+/*
+MotifOccOutcome
+	Classifier outcome cached for a motif occurrence in its extra_buffer.
+*/
+typedef struct{
+	double score;
+	int row;			// Gathered row pending classification, or -1 if score is set
+}MotifOccOutcome;
+
 class MotifClassifier_featureSet{
 private:
 	MotifClassifier_featureSet(motifList*_motifs);
@@ -33,11 +42,40 @@ public:
 	MotifClassifier_featureI*features;
 	std::vector<std::string> featureNames;
 	int nfeatures;
+	int reach;			// Distance from occurrences within which features are computed, including neighbour motif lengths
 	MotifClassifier_featureI*addFeature(MotifClassifier_feature f,int ia,int ib,int ic,double da,double db);
 	bool addFeatures(MotifClassifier_feature f,int ia,int ib,int ic,double da,double db);
-	bool getFeatures(double*out,motifOcc*o,motifOccContainer*moc,long long wpos,char*buf,int bufs);
+	bool getFeatures(double*out,motifOcc*o,motifOccContainer*moc,compositionIndex*comp,long long wpos,char*buf,int bufs);
+	/*
+	isInterior
+		Returns true if the features of the occurrence do not depend on
+		the edges of the window, such that they are the same in all
+		windows the occurrence is interior to.
+	*/
+	inline bool isInterior(motifOcc*o,long long wpos,int bufs){
+		return o->start-reach>=wpos&&o->start+o->mot->len+reach<=wpos+bufs;
+	}
+	/*
+	getCachedOutcome
+		Gets the classifier outcome cached for an interior occurrence.
+		Returns false if there is none.
+	*/
+	bool getCachedOutcome(motifOcc*o,long long wpos,int bufs,double&out);
+	/*
+	cacheOutcome
+		Caches the classifier outcome for an interior occurrence, so that
+		it is classified once while it remains in overlapping windows.
+	*/
+	bool cacheOutcome(motifOcc*o,long long wpos,int bufs,double v);
 };
 
+/*
+MOCCAOccBatchSize
+	Occurrence training examples classified per batched call when building
+	the log-odds training examples.
+*/
+#define MOCCAOccBatchSize 4096
+
 class MotifOccClassifier{
 private:
 	config*cfg;
@@ -47,25 +85,207 @@ private:
 	autofree<double> features;
 	motifList*motifs;
 	autodelete<MotifClassifier_featureSet> featureSet;
+	std::vector<motifOcc*> batchOccs;		// Occurrences classified in the last batch
+	std::vector<double> batchOutcomes;		// Outcomes for batchOccs
+	std::vector<int> batchRows;				// Indices in batchOccs of the uncached occurrences
+	autofree<double> batchFeatures;			// Feature matrix for the uncached occurrences, or kept training examples
+	autofree<seqClass*> batchClasses;		// Classes for the uncached occurrences
+	int batchCap;							// Rows there is room for in the batch buffers
+	std::vector<double> gathered;			// Feature vectors gathered over a batch of windows
+	std::vector<seqClass*> gatheredClasses;	// Classes for the gathered rows
+	std::vector<double> gatheredOutcomes;	// Outcomes for the gathered rows
 	MotifOccClassifier(int mi,motifList*ml);
 public:
 	~MotifOccClassifier(){  }
 	static MotifOccClassifier*create(int svmtype,int mi,motifList*ml);
-	bool trainOcc(motifOcc*o,motifOccContainer*moc,long long wpos,char*buf,int bufs,seqClass*_cls);
-	bool trainFinish();
-	double applyOcc(motifOcc*o,motifOccContainer*moc,long long wpos,char*buf,int bufs);
+	bool trainOcc(motifOcc*o,motifOccContainer*moc,compositionIndex*comp,long long wpos,char*buf,int bufs,seqClass*_cls);
+	/*
+	trainFeatures
+		Adds a training example from a precomputed occurrence feature vector.
+	*/
+	bool trainFeatures(double*f,seqClass*_cls);
+	/*
+	trainFinish
+		Trains the classifier. If keepExamples is set, the training examples
+		are kept for applyTrainingBatch until releaseTrainingExamples.
+	*/
+	bool trainFinish(bool keepExamples=false);
+	int getNTrainingExamples();
+	MotifClassifier_featureSet*getFeatureSet(){ return featureSet.ptr; }
+	int getNFeatures(){ return nfeatures; }
+	/*
+	applyFeaturesBatch
+		Classifies n precomputed occurrence feature vectors in the row-major
+		matrix m, and stores the outcomes (1 or -1) in out.
+	*/
+	bool applyFeaturesBatch(double*m,int n,double*out);
+	/*
+	applyTrainingBatch
+		Classifies the n kept training examples from r, and stores the
+		outcomes (1 or -1) in out.
+	*/
+	bool applyTrainingBatch(size_t r,int n,double*out);
+	void releaseTrainingExamples();
+	double applyOcc(motifOcc*o,motifOccContainer*moc,compositionIndex*comp,long long wpos,char*buf,int bufs);
+	/*
+	applyOccBatch
+		Classifies all occurrences of the motif in the window. Outcomes of
+		interior occurrences are taken from the cache where present, and
+		the features of the remaining occurrences are gathered into a
+		matrix that is classified in one batched call.
+		Returns the number of occurrences, or -1 on failure. occs and out
+		are set to the occurrences, in list order, and their outcomes.
+		These remain valid until the next call.
+	*/
+	int applyOccBatch(motifOccContainer*moc,compositionIndex*comp,long long wpos,char*buf,int bufs,motifOcc**&occs,double*&out);
+	/*
+	gatherOcc
+		Gets the outcome of an occurrence in one of a batch of consecutive
+		windows. If the outcome is cached, it is stored in v, and -1 is
+		returned. Otherwise, the features are gathered for classifyGathered,
+		and the row is returned, or -2 on failure. Interior occurrences are
+		gathered once per batch.
+	*/
+	int gatherOcc(motifOcc*o,motifOccContainer*moc,compositionIndex*comp,long long wpos,char*buf,int bufs,double&v);
+	/*
+	classifyGathered
+		Classifies the gathered feature vectors in one batched call, and
+		caches the outcomes of the gathered occurrences remaining in moc.
+	*/
+	bool classifyGathered(motifOccContainer*moc);
+	inline double getGatheredOutcome(int r){ return gatheredOutcomes[r]; }
+	/*
+	clearGathered
+		Clears the gathered feature vectors, for the next batch of windows.
+	*/
+	void clearGathered();
 	void printInfo();
 	bool exportAnalysisData(FILE*f);
 };
 
+////////////////////////////////////////////////////////////////////////////////////
+// MOCCA training
+
+/*
+MOCCAExtractFn
+	Extracts the features of all motif occurrences in the n training
+	sequences from iFirst. out[s*nmotifs+x] is set to the row-major
+	feature matrix for the occurrences of motif x in sequence iFirst+s.
+*/
+typedef std::function<bool(int iFirst,int n,std::vector<std::vector<double>>&out)> MOCCAExtractFn;
+
+/*
+trainMOCCAClassifiers
+	Two-pass training shared by the MOCCA variants. The occurrence features
+	are extracted in blocks of sequences, and added as training examples
+	of the occurrence classifiers in subcls, which are trained concurrently.
+	The training examples are kept through training for the second pass,
+	so that the features are only held once. The kept examples are then
+	classified in batches, with one task per motif, and the positive
+	occurrences per sequence are added as log-odds training examples.
+	T is the occurrence classifier type.
+*/
+template<class T> bool trainMOCCAClassifiers(std::vector<T*>&subcls,std::vector<trainingSequence*>&trainSeq,int block,MOCCAExtractFn extract,logoddsClassifier*classifier,double*fvec,int nThreads){
+	int nm=(int)subcls.size();
+	int nseq=(int)trainSeq.size();
+	// The rows of sequence s are seqRows[x][s] to seqRows[x][s+1]-1.
+	std::vector<std::vector<size_t>> seqRows(nm,std::vector<size_t>(1,0));
+	std::vector<std::vector<double>> blockFeatures;
+	for(int i=0;i<nseq;i+=block){
+		int n=std::min(block,nseq-i);
+		if(!extract(i,n,blockFeatures))return false;
+		for(int s=0;s<n;s++){
+			trainingSequence*ts=trainSeq[i+s];
+			for(int x=0;x<nm;x++){
+				std::vector<double>&m=blockFeatures[(size_t)s*nm+x];
+				int nf=subcls[x]->getNFeatures();
+				for(size_t r=0;r<m.size();r+=nf){
+					if(!subcls[x]->trainFeatures(&m[r],ts->cls)){
+						return false;
+					}
+				}
+				seqRows[x].push_back(seqRows[x].back()+m.size()/nf);
+				std::vector<double>().swap(m);
+			}
+		}
+	}
+	std::vector<std::vector<double>>().swap(blockFeatures);
+	// Train the occurrence classifiers concurrently, largest first.
+	std::vector<std::function<bool()>> tasks;
+	std::vector<size_t> costs;
+	for(T*sc: subcls){
+		tasks.push_back([sc]() -> bool { return sc->trainFinish(true); });
+		costs.push_back(sc->getNTrainingExamples());
+	}
+	if(!runParallel(tasks,costs,nThreads))return false;
+	// Classify the kept training examples, and count positive occurrences
+	// per sequence.
+	std::vector<int> nPositive((size_t)nseq*nm,0);
+	tasks.clear();
+	costs.clear();
+	for(int x=0;x<nm;x++){
+		T*c=subcls[x];
+		std::vector<size_t>*sr=&seqRows[x];
+		tasks.push_back([c,sr,x,nm,&nPositive]() -> bool {
+			size_t nrows=sr->back();
+			std::vector<double> outcomes(std::min(nrows,(size_t)MOCCAOccBatchSize));
+			int s=0;
+			for(size_t r=0;r<nrows;r+=MOCCAOccBatchSize){
+				int n=(int)std::min(nrows-r,(size_t)MOCCAOccBatchSize);
+				if(!c->applyTrainingBatch(r,n,outcomes.data())){
+					return false;
+				}
+				for(int y=0;y<n;y++){
+					while((*sr)[s+1]<=r+y)s++;
+					if(outcomes[y]>0)nPositive[(size_t)s*nm+x]++;
+				}
+			}
+			c->releaseTrainingExamples();
+			return true;
+		});
+		costs.push_back(seqRows[x].back());
+	}
+	if(!runParallel(tasks,costs,nThreads))return false;
+	// Log-odds training examples.
+	for(int s=0;s<nseq;s++){
+		trainingSequence*ts=trainSeq[s];
+		for(int x=0;x<nm;x++){
+			fvec[x]=double(nPositive[(size_t)s*nm+x]*1000)/double(ts->length);
+		}
+		if(!classifier->addTrain(fvec,nm,ts->cls)){
+			return false;
+		}
+	}
+	return classifier->train();
+}
+
 ////////////////////////////////////////////////////////////////////////////////////
 // SVM-MOCCA
 
+/*
+SVMMOCCATrainBlock
+	Training sequences per thread that are scanned in parallel before
+	the results are merged, in order, into the classifiers.
+*/
+#define SVMMOCCATrainBlock 32
+
+/*
+MOCCAWindowOcc
+	Motif occurrence in a window of a batch.
+*/
+typedef struct{
+	int motif;			// Motif index
+	long long start;	// Occurrence start
+	int row;			// Row gathered by the motif classifier, or -1 if the outcome is known
+	double outcome;		// Outcome, if known
+}MOCCAWindowOcc;
+
 class SVMMOCCA:public sequenceClassifier{
 private:
 	deletevector<MotifOccClassifier> subcls;
 	autodelete<motifWindow> mwin;
 	motifOccContainer*moc;
+	compositionIndex*comp;
 	motifList*motifs;
 	int svmtype;
 	SVMMOCCA(int nf,int _svmtype);
@@ -73,15 +293,47 @@ private:
 	autodelete<logoddsClassifier> classifier;
 	autofree<double>fvec;
 	deletevector<trainingSequence> trainSeq;
+	/*
+	extractTrainingFeatures
+		Scans the n training sequences from iFirst, split across the
+		windows in wins, and extracts the features of all motif
+		occurrences. out[s*nmotifs+x] is set to the row-major feature
+		matrix for the occurrences of motif x in sequence iFirst+s.
+	*/
+	bool extractTrainingFeatures(deletevector<motifWindow>&wins,int iFirst,int n,std::vector<std::vector<double>>&out);
+	std::vector<MOCCAWindowOcc> windowOccs;	// Occurrences of the windows of the last batch
+	std::vector<int> windowOccFirst;		// First entry in windowOccs per window, followed by the number of entries
+	/*
+	classifyWindowBatch
+		Reads the windows of the batch in order, and classifies the
+		occurrences of each motif, gathered over all windows, in one
+		batched call. Fills windowOccs.
+	*/
+	bool classifyWindowBatch(windowBatch*wb);
+	/*
+	getWindowFeatures
+		Sets out to the log-odds feature vector of window w of the last
+		batch, of length bufs. If motpos is not null, the positive
+		occurrences are added to it as motif predictions.
+	*/
+	void getWindowFeatures(int w,int bufs,double*out,vector<prediction>*motpos);
+	/*
+	predictMotifs
+		Predicts from the log-odds features in fvec and the motif
+		predictions of a window.
+	*/
+	vector<prediction> predictMotifs(long long pos,int bufs,corePredictionModeT cpm,vector<prediction>&motpos);
 public:
 	static SVMMOCCA*create(motifList*motifs,int _svmtype=C_SVC);
 	virtual ~SVMMOCCA(){  }
 	bool trainWindow(char*buf,long long pos,int bufs,seqClass*cls);
 	bool trainFinish();
 	double do_applyWindow(char*buf,long long pos,int bufs);
+	bool do_applyWindowBatch(windowBatch*wb);
 	bool flush();
 	bool printInfo();
 	bool exportAnalysisData(string path);
 	virtual vector<prediction> predictWindow(char*buf,long long pos,int bufs, corePredictionModeT cpm);
+	bool predictWindowBatch(windowBatch*wb,corePredictionModeT cpm,vector<vector<prediction>>&out);
 };
 
@@ -402,6 +402,8 @@ motifOccContainer::motifOccContainer(motifList*ml){
 	motifs=ml;
 	nOcc=0;
 	nOccT=0;
+	centersCap=0;
+	centersValid=false;
 }
 
 bool motifOccContainer::growTable(int ngrow){
@@ -519,6 +521,7 @@ motifOcc*motifOccContainer::createMotifOcc(long long start,motifListMotif*m,bool
 	ret->skip=false;
 	ret->extra_buffer=0;
 	ret->score=score;
+	centersValid=false;
 	return ret;
 }
 
@@ -542,6 +545,7 @@ bool motifOccContainer::freeMotifOcc(motifOcc*o){
 	o->iFNext=iFree;
 	iFree=ind;
 	o->active=false;
+	centersValid=false;
 	nOcc--;
 	nOccT[o->mot->index]--;
 	if(o->iFNext!=-1&&occTbl[o->iFNext].active)cmdWarning("Next free motif occurrence pointer to an active motif occurrence.");
@@ -553,6 +557,12 @@ bool motifOccContainer::freeMotifOcc(motifOcc*o){
 }
 
 void motifOccContainer::flush(){
+	for(motifOcc*o=getFirst();o;o=getNext(o)){
+		if(o->extra_buffer){
+			free(o->extra_buffer);
+			o->extra_buffer=0;
+		}
+	}
 	iAFirst=iALast=-1;
 	for(int l=0;l<motifs->nmotifs;l++){
 		iAFirstT[l]=-1;
@@ -568,6 +578,43 @@ void motifOccContainer::flush(){
 	occTbl[tblSize-1].iFNext=-1;
 	occTbl[tblSize-1].active=false;
 	iFree=0;
+	centersValid=false;
+}
+
+bool motifOccContainer::indexCenters(){
+	if(!iCenters.ptr){
+		if(!iCenters.resize(motifs->nmotifs+1))return false;
+	}
+	if(nOcc>centersCap){
+		if(!centers.resize(nOcc)){
+			centersCap=0;
+			return false;
+		}
+		centersCap=nOcc;
+	}
+	int n=0;
+	for(int t=0;t<motifs->nmotifs;t++){
+		iCenters[t]=n;
+		for(motifOcc*o=getFirst(t);o;o=getNextSame(o))
+			centers[n++]=o->start*2+o->mot->len;
+		std::sort(centers.ptr+iCenters[t],centers.ptr+n);
+	}
+	iCenters[motifs->nmotifs]=n;
+	centersValid=true;
+	return true;
+}
+
+int motifOccContainer::countCentersWithin(int t,long long c2,int d){
+	if(!centersValid){
+		if(!indexCenters())return -1;
+	}
+	if(d<=0)return 0;
+	long long*a=centers.ptr+iCenters[t];
+	long long*b=centers.ptr+iCenters[t+1];
+	// |c-c2| < 2d, with c and c2 doubled
+	long long*lo=std::lower_bound(a,b,c2-2*(long long)d+1);
+	long long*hi=std::lower_bound(lo,b,c2+2*(long long)d);
+	return int(hi-lo);
 }
 
 motifOcc*motifOccContainer::getFirst(){
@@ -899,6 +946,21 @@ public:
 		cout << t_indent << t_indent << "Motifs: " << nmotifsused << "\n";
 		return r;
 	}
+	/*
+	share
+		Creates a finite state machine with its own parsing state, sharing
+		the graph of base. base must outlive it.
+	*/
+	static motifFSM*share(motifFSM*base){
+		motifFSM*r=new motifFSM();
+		if(!r){
+			outOfMemory();
+			return 0;
+		}
+		r->rootNode=base->rootNode;
+		r->flush();
+		return r;
+	}
 	~motifFSM(){
 		if(nodes){
 			for(int l=0;l<nnodes;l++){
@@ -953,6 +1015,7 @@ public:
 
 motifWindow::motifWindow(motifList*_motifs){
 	occContainer=0;
+	composition=0;
 	mFSM=0;
 	motifs=_motifs;
 }
@@ -1090,6 +1153,8 @@ bool motifWindow::motifMatchPWM(char*seq,int seqlen,motifListMotif*mot,bool com,
 
 motifWindow::~motifWindow(){
 	if(occContainer)delete occContainer;
+	if(composition)delete composition;
+	if(mFSM)delete mFSM;
 }
 
 motifWindow*motifWindow::create(motifList*_motifs){
@@ -1112,6 +1177,29 @@ motifWindow*motifWindow::create(motifList*_motifs){
 	return r;
 }
 
+motifWindow*motifWindow::createShared(motifWindow*base){
+	autodelete<motifWindow> r(new motifWindow(base->motifs));
+	if(!r.ptr){
+		outOfMemory();
+		return 0;
+	}
+	r.ptr->occContainer=motifOccContainer::create(128,base->motifs);
+	if(!r.ptr->occContainer){
+		return 0;
+	}
+	if(base->mFSM){
+		r.ptr->mFSM=motifFSM::share(base->mFSM);
+		if(!r.ptr->mFSM){
+			return 0;
+		}
+	}
+	if(base->composition){
+		if(!r.ptr->enableCompositionIndex())
+			return 0;
+	}
+	return r.disown();
+}
+
 bool motifWindow::flush(){
 	if(!occContainer){
 		cmdError("Occurrence container not created.");
@@ -1119,6 +1207,7 @@ bool motifWindow::flush(){
 	}
 	occContainer->flush();
 	if(mFSM)mFSM->flush();
+	if(composition)composition->flush();
 	wPos=0;
 	wLen=0;
 	return true;
@@ -1145,6 +1234,10 @@ bool motifWindow::readWindow(char*wseq,long long wpos,int wlen){
 			}
 		}
 	}
+	if(composition){
+		if(!composition->update(wseq,wpos,wlen))
+			return false;
+	}
 	int wstartbase=int(wPos+(long long)wLen-wpos); // Start at the end of the previous window, localized to the new one.
 	wPos=wpos;
 	wLen=wlen;
@@ -1227,6 +1320,103 @@ bool motifWindow::readWindow(char*wseq,long long wpos,int wlen){
 	return true;
 }
 
+bool motifWindow::enableCompositionIndex(){
+	if(composition)return true;
+	composition=compositionIndex::create();
+	if(!composition)return false;
+	// The index has to start with the next window read.
+	return flush();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Composition index
+
+static inline int compositionNucleotide(char c){
+	switch(c){
+		case 'A':return 0;
+		case 'T':return 1;
+		case 'G':return 2;
+		case 'C':return 3;
+		default:return -1;
+	}
+}
+
+compositionIndex::compositionIndex(){
+	basePos=0;
+	n=0;
+	cap=0;
+}
+
+compositionIndex*compositionIndex::create(){
+	compositionIndex*r=new compositionIndex();
+	if(!r){
+		outOfMemory();
+		return 0;
+	}
+	return r;
+}
+
+void compositionIndex::flush(){
+	basePos=0;
+	n=0;
+}
+
+bool compositionIndex::update(char*wseq,long long wpos,int wlen){
+	long long end=basePos+n;
+	if(!n||wpos<basePos||wpos>=end){
+		// Not overlapping, so start over
+		basePos=wpos;
+		n=0;
+		end=wpos;
+	}
+	long long wend=wpos+wlen;
+	if(wend<=end)return true;
+	if(int(wend-basePos)>cap){
+		// Drop nucleotides before the window
+		int drop=int(wpos-basePos);
+		if(drop>0){
+			memmove(gc.ptr,gc.ptr+drop,sizeof(int)*(n-drop+1));
+			memmove(dnt.ptr,dnt.ptr+drop*16,sizeof(int)*16*(n-drop+1));
+			basePos=wpos;
+			n-=drop;
+		}
+		int ncap=int(wend-basePos);
+		if(ncap>cap){
+			ncap=max(ncap,cap*2);
+			if(!gc.resize(ncap+1)||!dnt.resize((ncap+1)*16))
+				return false;
+			cap=ncap;
+		}
+	}
+	if(!n){
+		gc[0]=0;
+		memset(dnt.ptr,0,sizeof(int)*16);
+	}
+	int i=n;
+	for(long long p=end;p<wend;p++,i++){
+		char c=wseq[p-wpos];
+		gc[i+1]=gc[i]+((c=='G'||c=='C')?1:0);
+		int*drow=&dnt.ptr[(i+1)*16];
+		memcpy(drow,drow-16,sizeof(int)*16);
+		if(i>=1){
+			int ca=compositionNucleotide(wseq[p-1-wpos]),cb=compositionNucleotide(c);
+			if(ca!=-1&&cb!=-1)drow[(ca<<2)|cb]++;
+		}
+	}
+	n=i;
+	return true;
+}
+
+void compositionIndex::getDNT(long long a,long long b,int*out){
+	if(b<=a+1){
+		memset(out,0,sizeof(int)*16);
+		return;
+	}
+	int*ra=&dnt.ptr[int(a+1-basePos)*16];
+	int*rb=&dnt.ptr[int(b-basePos)*16];
+	for(int k=0;k<16;k++)out[k]=rb[k]-ra[k];
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // PWM threshold calibration
 
@@ -1333,3 +1523,89 @@ bool isMotifPair(motifOcc*a,motifOcc*b,int cutMin,int cutMax){
 	return dist>=cutMin&&dist<=cutMax;
 }
 
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Motif pair counter
+
+motifPairCounter::motifPairCounter(motifWindow*mw,int _cutMax){
+	mwin=mw;
+	moc=mw->occContainer;
+	nmotifs=mw->motifs->nmotifs;
+	cutMax=_cutMax;
+	cPos=0;
+	cLen=0;
+}
+
+motifPairCounter*motifPairCounter::create(motifWindow*mw,int cutMax){
+	if(!mw){
+		cmdError("motifPairCounter::create(): Null-pointer argument.");
+		return 0;
+	}
+	autodelete<motifPairCounter> r(new motifPairCounter(mw,cutMax));
+	if(!r.ptr){
+		outOfMemory();
+		return 0;
+	}
+	if(!r.ptr->counts.resize(r.ptr->nmotifs*r.ptr->nmotifs)){
+		return 0;
+	}
+	r.ptr->counts.fill(r.ptr->nmotifs*r.ptr->nmotifs,0);
+	return r.disown();
+}
+
+void motifPairCounter::countAll(){
+	counts.fill(nmotifs*nmotifs,0);
+	// Every unordered pair is visited once, including self-pairs.
+	for(motifOcc*o=moc->getFirst();o;o=moc->getNext(o)){
+		int ia=o->mot->index;
+		for(motifOcc*o2=o;o2;o2=moc->getNext(o2)){
+			if(!isMotifPair(o,o2,0,cutMax))continue;
+			int ib=o2->mot->index;
+			if(ia<=ib)counts[ia*nmotifs+ib]++;
+			else counts[ib*nmotifs+ia]++;
+		}
+	}
+}
+
+void motifPairCounter::updateOccurrence(motifOcc*n,int w,long long changeStart,long long changeEnd){
+	int ia=n->mot->index;
+	for(motifOcc*x=moc->getFirst();x;x=moc->getNext(x)){
+		// Pairs of two changed occurrences are handled from the first one.
+		if((x->start<changeStart||x->start+x->mot->len>changeEnd)&&x>n)continue;
+		if(!isMotifPair(n,x,0,cutMax))continue;
+		int ib=x->mot->index;
+		if(ia<=ib)counts[ia*nmotifs+ib]+=w;
+		else counts[ib*nmotifs+ia]+=w;
+	}
+}
+
+bool motifPairCounter::readWindow(char*wseq,long long wpos,int wlen){
+	// Update incrementally if the window overlaps the one the counts are valid for.
+	bool incremental=cLen&&mwin->wPos==cPos&&mwin->wLen==cLen
+		&&wpos>=cPos&&wpos<cPos+cLen;
+	long long prevEnd=mwin->wPos+mwin->wLen;
+	cLen=0;
+	if(incremental){
+		for(motifOcc*o=moc->getFirst();o;o=moc->getNext(o)){
+			if(o->start<wpos)updateOccurrence(o,-1,wpos,LLONG_MAX);
+		}
+	}
+	if(!mwin->readWindow(wseq,wpos,wlen)){
+		return false;
+	}
+	if(incremental){
+		for(motifOcc*o=moc->getFirst();o;o=moc->getNext(o)){
+			if(o->start+o->mot->len>prevEnd)updateOccurrence(o,1,LLONG_MIN,prevEnd);
+		}
+	}else{
+		countAll();
+	}
+	cPos=mwin->wPos;
+	cLen=mwin->wLen;
+	return true;
+}
+
+int motifPairCounter::getNPair(int ia,int ib){
+	if(ia<=ib)return counts[ia*nmotifs+ib];
+	return counts[ib*nmotifs+ia];
+}
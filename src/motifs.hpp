@@ -143,6 +143,10 @@ private:
 	int*iAFirstT,*iALastT;		// Indices of first and last active table entries of specific types.
 	int iFree;				// Index of first free table entry.
 	motifList*motifs;			// Motifs.
+	autofree<long long> centers;	// Doubled occurrence centers, sorted by type and position.
+	autofree<int> iCenters;		// Index in centers of the first center of each type. nmotifs+1 entries.
+	int centersCap;				// Number of centers there is room for.
+	bool centersValid;			// True if centers are up to date.
 	// Private constructor
 	motifOccContainer(motifList*ml);
 	/*
@@ -150,6 +154,11 @@ private:
 		Expands the table by the given number of entries.
 	*/
 	bool growTable(int ngrow);
+	/*
+	indexCenters
+		Rebuilds the position-sorted per-type index of occurrence centers.
+	*/
+	bool indexCenters();
 public:
 	motifList*getMotifList();
 	// Destruction
@@ -188,6 +197,15 @@ public:
 	motifOcc*getLast(int t);
 	motifOcc*getNextSame(motifOcc*o);
 	motifOcc*getPrevSame(motifOcc*o);
+	/*
+	countCentersWithin
+		Returns the number of occurrences of type t with centers less than
+		d base pairs from the center c2/2, where c2 is twice the center
+		position (2*start+len). Uses a position-sorted index of occurrence
+		centers, which is rebuilt after occurrences have changed.
+		Returns -1 on failure.
+	*/
+	int countCentersWithin(int t,long long c2,int d);
 };
 
 ////////////////////////////////////////////////////////////////////////////////////
@@ -195,6 +213,58 @@ public:
 
 void initIUPACTbl();
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Composition index
+
+/*
+compositionIndex
+	Prefix sums of G/C and dinucleotide counts over the sequence read by a
+	motif window, such that the composition of any range is found in
+	constant time. When consecutive windows overlap, only the new tail is
+	indexed. Positions are absolute, as for motif occurrences.
+	Dinucleotides are indexed as (first<<2)|second, with A=0, T=1, G=2
+	and C=3, and only count if both nucleotides are valid.
+*/
+class compositionIndex{
+private:
+	autofree<int> gc;		// gc[i]: Number of G/C in [basePos, basePos+i)
+	autofree<int> dnt;		// dnt[i*16+k]: Number of dinucleotides k ending in [basePos+1, basePos+i)
+	long long basePos;		// Position of the first indexed nucleotide
+	int n;					// Number of indexed nucleotides
+	int cap;				// Number of nucleotides there is room for
+	compositionIndex();
+public:
+	/*
+	create
+		Call to construct
+	*/
+	static compositionIndex*create();
+	/*
+	flush
+		Clears the index.
+	*/
+	void flush();
+	/*
+	update
+		Indexes a window. If it overlaps the indexed range, only the new
+		part is indexed, and nucleotides before wpos are dropped.
+	*/
+	bool update(char*wseq,long long wpos,int wlen);
+	/*
+	getGC
+		Returns the number of G/C in [a, b).
+	*/
+	inline int getGC(long long a,long long b){
+		return gc[int(b-basePos)]-gc[int(a-basePos)];
+	}
+	/*
+	getDNT
+		Sets out[0..15] to the numbers of dinucleotides with both
+		nucleotides within [a, b).
+	*/
+	void getDNT(long long a,long long b,int*out);
+};
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Motif window
 
@@ -215,6 +285,7 @@ public:
 	int wLen;
 	motifOccContainer*occContainer;
 	motifList*motifs;
+	compositionIndex*composition;	// Composition index, if enabled
 	
 	/*
 	motifMatchIUPAC
@@ -230,9 +301,22 @@ public:
 	// Construction
 	~motifWindow();
 	static motifWindow*create(motifList*_motifs);
+	/*
+	createShared
+		Creates a window for the same motifs as base, sharing its motif
+		finite state machine graph, but with its own parsing state and
+		occurrences. Windows can then be read concurrently. base must
+		outlive the window.
+	*/
+	static motifWindow*createShared(motifWindow*base);
 	// Processing
 	bool flush();
 	bool readWindow(char*wseq,long long wpos,int wlen);
+	/*
+	enableCompositionIndex
+		Makes readWindow maintain a composition index for the windows.
+	*/
+	bool enableCompositionIndex();
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -250,3 +334,51 @@ bool overlapping(motifOcc*a,motifOcc*b);
 
 bool isMotifPair(motifOcc*a,motifOcc*b,int cutMin,int cutMax);
 
+/*
+motifPairCounter
+	Counts motif occurrence pairs for all combinations of motifs in a motif
+	window, with isMotifPair. Homotypic counts include self-pairs.
+	When consecutive windows overlap, the counts are updated incrementally
+	from the occurrences that leave and enter the window.
+*/
+class motifPairCounter{
+private:
+	motifWindow*mwin;
+	motifOccContainer*moc;
+	int nmotifs;
+	int cutMax;
+	autofree<int> counts;	// Pair counts, indexed by ia*nmotifs+ib, with ia<=ib
+	long long cPos;			// Window position the counts are valid for
+	int cLen;				// Window length the counts are valid for. 0 if invalid.
+	motifPairCounter(motifWindow*mw,int _cutMax);
+	/*
+	countAll
+		Counts all pairs from scratch.
+	*/
+	void countAll();
+	/*
+	updateOccurrence
+		Adds w times the pairs of occurrence n. Pairs with other changed
+		occurrences, as indicated by changeStart and changeEnd, are only
+		counted once.
+	*/
+	void updateOccurrence(motifOcc*n,int w,long long changeStart,long long changeEnd);
+public:
+	/*
+	create
+		Call to construct
+		Does not assume ownership of the motif window.
+	*/
+	static motifPairCounter*create(motifWindow*mw,int cutMax);
+	/*
+	readWindow
+		Reads the window with the motif window, and updates the counts.
+	*/
+	bool readWindow(char*wseq,long long wpos,int wlen);
+	/*
+	getNPair
+		Returns the number of pairs for the motifs.
+	*/
+	int getNPair(int ia,int ib);
+};
+
@@ -242,3 +242,43 @@ timer::~timer(){
 	printf("(%s): %d:%02d:%02d\n", name, hr, min, sec);
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Parallel tasks
+
+static thread_local bool parallelWorker=false;
+
+bool isParallelWorker(){
+	return parallelWorker;
+}
+
+bool runParallel(std::vector<std::function<bool()>>&tasks,std::vector<size_t>&costs,int nThreads){
+	int n=(int)tasks.size();
+	if(nThreads>n)nThreads=n;
+	if(nThreads<=1||parallelWorker){
+		for(auto&t:tasks){
+			if(!t())return false;
+		}
+		return true;
+	}
+	std::vector<int> order(n);
+	for(int i=0;i<n;i++)order[i]=i;
+	std::stable_sort(order.begin(),order.end(),[&costs](int a,int b){
+		return costs[a]>costs[b];
+	});
+	std::atomic<int> next(0);
+	std::atomic<bool> ok(true);
+	auto worker=[&](){
+		parallelWorker=true;
+		while(ok){
+			int i=next++;
+			if(i>=n)break;
+			if(!tasks[order[i]]())ok=false;
+		}
+		parallelWorker=false;
+	};
+	std::vector<std::thread> threads;
+	for(int t=1;t<nThreads;t++)threads.push_back(std::thread(worker));
+	worker();
+	for(auto&t:threads)t.join();
+	return ok;
+}
@@ -138,6 +138,10 @@ public:
 	inline T* operator [](int i){
 		return v[i];
 	}
+	inline void clear(){
+		for(T*e:v)if(e)delete e;
+		std::vector<T*>().swap(v);
+	}
 };
 
 char*cloneString(char*sstr);
@@ -184,3 +188,20 @@ public:
 	~timer();
 };
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Parallel tasks
+
+/*
+runParallel
+	Runs independent tasks on up to nThreads threads, and returns false if
+	any task fails. Tasks are handed out in order of decreasing cost, so
+	that the largest tasks do not end up last. Calls from within a task
+	run serially on the calling thread.
+*/
+bool runParallel(std::vector<std::function<bool()>>&tasks,std::vector<size_t>&costs,int nThreads);
+
+/*
+isParallelWorker
+	Returns true if called from within a task run by runParallel.
+*/
+bool isParallelWorker();